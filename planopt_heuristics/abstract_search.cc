@@ -0,0 +1,114 @@
+#include "abstract_search.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <tuple>
+
+using namespace std;
+
+namespace planopt_heuristics {
+AbstractDistanceCalculator::AbstractDistanceCalculator(
+    const TNFTask &task, const Pattern &pattern, PDBCollection heuristic_pdbs)
+    : projection(task, pattern),
+      heuristic_pdbs(move(heuristic_pdbs)),
+      original_state(task.variable_domains.size(), 0) {
+    const TNFTask &projected_task = projection.get_projected_task();
+    known_distances[projection.rank_state(projected_task.goal_state)] = 0;
+}
+
+int AbstractDistanceCalculator::compute_heuristic(int index, const TNFState &abstract_state) {
+    auto it = known_distances.find(index);
+    if (it != known_distances.end()) {
+        return it->second;
+    }
+    const Pattern &pattern = projection.get_pattern();
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        original_state[pattern[i]] = abstract_state[i];
+    }
+    int h = 0;
+    for (const shared_ptr<PatternDatabase> &pdb : heuristic_pdbs) {
+        h = max(h, pdb->lookup_distance(original_state));
+    }
+    return h;
+}
+
+int AbstractDistanceCalculator::compute_distance_of_index(int index) {
+    auto known = known_distances.find(index);
+    if (known != known_distances.end()) {
+        return known->second;
+    }
+    const TNFTask &projected_task = projection.get_projected_task();
+    const int INF = numeric_limits<int>::max();
+
+    // Entries (f, -g, index): ties are broken in favor of larger g.
+    using OpenEntry = tuple<int, int, int>;
+    priority_queue<OpenEntry, vector<OpenEntry>, greater<OpenEntry>> open;
+    unordered_map<int, int> g_values;
+    unordered_map<int, int> parents;
+    int initial_h = compute_heuristic(index, projection.unrank_state(index));
+    if (initial_h != INF) {
+        g_values[index] = 0;
+        parents[index] = -1;
+        open.emplace(initial_h, 0, index);
+    }
+    while (!open.empty()) {
+        int g = -get<1>(open.top());
+        int state_index = get<2>(open.top());
+        open.pop();
+        if (g > g_values[state_index]) {
+            continue;
+        }
+        known = known_distances.find(state_index);
+        if (known != known_distances.end()) {
+            /*
+              The exact distance of the expanded state makes its f value
+              the optimal solution cost, so all states on the path to it
+              get exact distances.
+            */
+            int distance = g + known->second;
+            for (int path_index = state_index; path_index != -1;
+                 path_index = parents[path_index]) {
+                known_distances[path_index] = distance - g_values[path_index];
+            }
+            return distance;
+        }
+
+        TNFState state = projection.unrank_state(state_index);
+        for (const TNFOperator &op : projected_task.operators) {
+            bool applicable = true;
+            for (const TNFOperatorEntry &entry : op.entries) {
+                if (state[entry.variable_id] != entry.precondition_value ||
+                    projection.violates_mutex(state, entry.variable_id,
+                                              entry.precondition_value)) {
+                    applicable = false;
+                    break;
+                }
+            }
+            if (!applicable) {
+                continue;
+            }
+            TNFState successor(state);
+            for (const TNFOperatorEntry &entry : op.entries) {
+                successor[entry.variable_id] = entry.effect_value;
+            }
+            int successor_index = projection.rank_state(successor);
+            int successor_g = g + op.cost;
+            auto g_it = g_values.find(successor_index);
+            if (g_it != g_values.end() && g_it->second <= successor_g) {
+                continue;
+            }
+            int h = compute_heuristic(successor_index, successor);
+            if (h == INF) {
+                continue;
+            }
+            g_values[successor_index] = successor_g;
+            parents[successor_index] = state_index;
+            open.emplace(successor_g + h, -successor_g, successor_index);
+        }
+    }
+    known_distances[index] = INF;
+    return INF;
+}
+}
@@ -0,0 +1,45 @@
+#ifndef PLANOPT_HEURISTICS_ABSTRACT_SEARCH_H
+#define PLANOPT_HEURISTICS_ABSTRACT_SEARCH_H
+
+#include "pdb.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace planopt_heuristics {
+/*
+  Goal distances in the projection to a pattern for single abstract states,
+  computed with A* instead of a regression over all abstract states. The
+  heuristic is the maximum over the given PDBs, whose patterns must be
+  subsets of the pattern. Like the regression of a PatternDatabase, the
+  search does not use transitions from states that violate a mutex of the
+  task on the variables of the operator, so the distances are the ones the
+  PDB of the pattern would store.
+
+  The exact distances of all states on the optimal paths found so far are
+  remembered. They serve as perfect heuristic values and A* stops as soon
+  as it expands such a state.
+*/
+class AbstractDistanceCalculator {
+    Projection projection;
+    PDBCollection heuristic_pdbs;
+    std::unordered_map<int, int> known_distances;
+    // State of the original task for lookups in heuristic_pdbs.
+    TNFState original_state;
+
+    int compute_heuristic(int index, const TNFState &abstract_state);
+public:
+    AbstractDistanceCalculator(
+        const TNFTask &task, const Pattern &pattern, PDBCollection heuristic_pdbs);
+
+    // Goal distance of the abstract state with the given index.
+    int compute_distance_of_index(int index);
+    // Goal distance of the projection of a state of the original task.
+    template<typename State>
+    int compute_distance(const State &state) {
+        return compute_distance_of_index(projection.rank_original_state(state));
+    }
+};
+}
+
+#endif
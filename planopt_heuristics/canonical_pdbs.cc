@@ -1,6 +1,10 @@
 #include "canonical_pdbs.h"
 
 #include "../algorithms/max_cliques.h"
+#include "../utils/logging.h"
+
+#include <algorithm>
+#include <numeric>
 
 using namespace std;
 
@@ -61,37 +65,275 @@ vector<vector<int>> build_compatibility_graph(const vector<Pattern> &patterns, c
 }
 
 CanonicalPatternDatabases::CanonicalPatternDatabases(
-    const TNFTask &task, const vector<Pattern> &patterns) {
-    for (const Pattern &pattern : patterns) {
-        pdbs.emplace_back(task, pattern);
+    const TNFTask &task, const vector<Pattern> &patterns)
+    : CanonicalPatternDatabases(task, build_pattern_databases(task, patterns, 1)) {
+}
+
+CanonicalPatternDatabases::CanonicalPatternDatabases(
+    const TNFTask &task, PDBCollection pattern_databases)
+    : pdbs(move(pattern_databases)),
+      clique_pruning_warm_up(0),
+      num_evaluations(0),
+      cliques_pruned(false) {
+    vector<Pattern> patterns;
+    patterns.reserve(pdbs.size());
+    for (const shared_ptr<PatternDatabase> &pdb : pdbs) {
+        patterns.push_back(pdb->get_projection().get_pattern());
     }
 
     vector<vector<int>> compatibility_graph = build_compatibility_graph(patterns, task);
     max_cliques::compute_max_cliques(compatibility_graph, maximal_additive_sets);
+    active_cliques.resize(maximal_additive_sets.size());
+    iota(active_cliques.begin(), active_cliques.end(), 0);
+    active_pdbs.resize(pdbs.size());
+    iota(active_pdbs.begin(), active_pdbs.end(), 0);
 
+    for (size_t pdb_id = 0; pdb_id < pdbs.size(); ++pdb_id) {
+        if (pdbs[pdb_id]->get_dead_state_fraction() > 0) {
+            dead_end_order.push_back(pdb_id);
+        }
+    }
+    stable_sort(dead_end_order.begin(), dead_end_order.end(), [this](int i, int j) {
+            return pdbs[i]->get_dead_state_fraction() > pdbs[j]->get_dead_state_fraction();
+        });
 }
 
-int CanonicalPatternDatabases::compute_heuristic(const TNFState &original_state) {
+void CanonicalPatternDatabases::prepare_incremental_indices(const TNFTask &task) {
     /*
-      To avoid the overhead of looking up the heuristic value of a PDB multiple
-      times (if that PDB occurs in multiple cliques), we pre-compute all
-      heuristic values. Use heuristic_values[i] for the heuristic value of
-      pdbs[i] in your code below.
+      The operators of the SAS+ task keep their ids in the TNF task. The
+      forget operators appended after them never occur in the search, so their
+      updates are never used.
     */
-    vector<int> heuristic_values;
-    heuristic_values.reserve(pdbs.size());
-    for (const PatternDatabase &pdb : pdbs) {
-        heuristic_values.push_back(pdb.lookup_distance(original_state));
+    int num_operators = task.operators.size();
+    index_updates.assign(num_operators, {});
+    for (size_t pdb_id = 0; pdb_id < pdbs.size(); ++pdb_id) {
+        const Projection &projection = pdbs[pdb_id]->get_projection();
+        const Pattern &pattern = projection.get_pattern();
+        const vector<int> &multipliers = projection.get_perfect_hash_multipliers();
+        for (int op_id = 0; op_id < num_operators; ++op_id) {
+            const TNFOperator &op = task.operators[op_id];
+            for (size_t i = 0; i < pattern.size(); ++i) {
+                for (const TNFOperatorEntry &entry : op.entries) {
+                    if (entry.variable_id != pattern[i] ||
+                        entry.precondition_value == entry.effect_value) {
+                        continue;
+                    }
+                    int multiplier = multipliers[i];
+                    int effect_value = projection.get_abstract_value(i, entry.effect_value);
+                    if (task.is_unknown_value(entry.variable_id, entry.precondition_value)) {
+                        const ValueMapping *value_mapping = nullptr;
+                        if (projection.is_domain_abstraction()) {
+                            value_mapping = &projection.get_value_mappings()[i];
+                        }
+                        index_updates[op_id].emplace_back(
+                            pdb_id, multiplier * effect_value,
+                            entry.variable_id, multiplier, value_mapping);
+                    } else {
+                        int precondition_value =
+                            projection.get_abstract_value(i, entry.precondition_value);
+                        index_updates[op_id].emplace_back(
+                            pdb_id, multiplier * (effect_value - precondition_value),
+                            -1, 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void CanonicalPatternDatabases::compute_abstract_indices(
+    const TNFState &original_state, vector<int> &indices) const {
+    indices.clear();
+    indices.reserve(pdbs.size());
+    for (const shared_ptr<PatternDatabase> &pdb : pdbs) {
+        indices.push_back(pdb->compute_index(original_state));
+    }
+}
+
+int CanonicalPatternDatabases::compute_heuristic_from_indices(const vector<int> &indices) const {
+    if (has_dead_index(indices)) {
+        return numeric_limits<int>::max();
+    }
+    for (int pdb_id : active_pdbs) {
+        pdbs[pdb_id]->prefetch_index(indices[pdb_id]);
+    }
+    scratch_values.assign(indices.begin(), indices.end());
+    return compute_heuristic_from_prefetched_indices(scratch_values);
+}
+
+int CanonicalPatternDatabases::compute_heuristic_from_prefetched_indices(vector<int> &values) const {
+    for (int i : active_pdbs) {
+        values[i] = pdbs[i]->lookup_index(values[i]);
         /*
           special case: if one of the PDBs detects unsolvability, we can
           return infinity right away. Otherwise, we would have to deal with
           integer overflows when adding numbers below.
         */
-        if (heuristic_values.back() == numeric_limits<int>::max()) {
+        if (values[i] == numeric_limits<int>::max()) {
             return numeric_limits<int>::max();
         }
     }
+    return compute_max_over_active_cliques(values);
+}
+
+void CanonicalPatternDatabases::enable_clique_pruning(int warm_up) {
+    clique_pruning_warm_up = warm_up;
+    num_evaluations = 0;
+    cliques_pruned = false;
+    clique_wins.assign(maximal_additive_sets.size(), 0);
+    pdb_contributions.assign(pdbs.size(), 0);
+}
+
+int CanonicalPatternDatabases::compute_max_over_active_cliques(
+    const vector<int> &heuristic_values) const {
+    int h = 0;
+    int best_clique = -1;
+    for (int clique_id : active_cliques) {
+        int clique_value = 0;
+        for (int pdb_id : maximal_additive_sets[clique_id]) {
+            clique_value += heuristic_values[pdb_id];
+        }
+        if (best_clique == -1 || clique_value > h) {
+            h = clique_value;
+            best_clique = clique_id;
+        }
+    }
+
+    if (clique_pruning_warm_up > 0 && best_clique != -1) {
+        ++clique_wins[best_clique];
+        for (int pdb_id : maximal_additive_sets[best_clique]) {
+            ++pdb_contributions[pdb_id];
+        }
+        if (++num_evaluations == clique_pruning_warm_up) {
+            prune_cliques();
+        }
+    }
+    return h;
+}
+
+void CanonicalPatternDatabases::prune_cliques() const {
+    vector<int> kept_cliques;
+    for (int clique_id : active_cliques) {
+        if (clique_wins[clique_id] > 0) {
+            kept_cliques.push_back(clique_id);
+        }
+    }
+    vector<bool> used(pdbs.size(), false);
+    for (int clique_id : kept_cliques) {
+        for (int pdb_id : maximal_additive_sets[clique_id]) {
+            used[pdb_id] = true;
+        }
+    }
+    vector<int> kept_pdbs;
+    for (size_t pdb_id = 0; pdb_id < pdbs.size(); ++pdb_id) {
+        if (used[pdb_id]) {
+            kept_pdbs.push_back(pdb_id);
+        }
+    }
+    int num_contributing_pdbs = count_if(
+        pdb_contributions.begin(), pdb_contributions.end(),
+        [](int contributions) {return contributions > 0; });
+
+    g_log << "Clique pruning after " << num_evaluations << " evaluations: kept "
+          << kept_cliques.size() << " of " << active_cliques.size()
+          << " cliques and " << kept_pdbs.size() << " of " << pdbs.size()
+          << " PDBs (" << num_contributing_pdbs
+          << " PDBs contributed to a maximal clique)" << endl;
+    active_cliques = move(kept_cliques);
+    active_pdbs = move(kept_pdbs);
+    cliques_pruned = true;
+}
+
+// Ids of the at most max_ids largest positive counts, largest first.
+static vector<int> get_top_ids(const vector<int> &counts, size_t max_ids) {
+    vector<int> ids;
+    for (size_t id = 0; id < counts.size(); ++id) {
+        if (counts[id] > 0) {
+            ids.push_back(id);
+        }
+    }
+    sort(ids.begin(), ids.end(), [&counts](int lhs, int rhs) {
+            return counts[lhs] > counts[rhs];
+        });
+    if (ids.size() > max_ids) {
+        ids.resize(max_ids);
+    }
+    return ids;
+}
+
+void CanonicalPatternDatabases::print_clique_pruning_statistics() const {
+    if (clique_pruning_warm_up == 0) {
+        return;
+    }
+    const size_t num_reported = 5;
+    g_log << "Clique pruning statistics after " << num_evaluations
+          << " evaluations: evaluated " << active_cliques.size() << " of "
+          << maximal_additive_sets.size() << " cliques and " << active_pdbs.size()
+          << " of " << pdbs.size() << " PDBs" << endl;
+    for (int clique_id : get_top_ids(clique_wins, num_reported)) {
+        vector<Pattern> clique_patterns;
+        for (int pdb_id : maximal_additive_sets[clique_id]) {
+            clique_patterns.push_back(pdbs[pdb_id]->get_projection().get_pattern());
+        }
+        g_log << "Clique " << clique_patterns << " was maximal in "
+              << clique_wins[clique_id] << " evaluations" << endl;
+    }
+    for (int pdb_id : get_top_ids(pdb_contributions, num_reported)) {
+        g_log << "PDB " << pdbs[pdb_id]->get_projection().get_pattern()
+              << " contributed to the maximum in " << pdb_contributions[pdb_id]
+              << " evaluations" << endl;
+    }
+}
 
+vector<int> CanonicalPatternDatabases::compute_heuristics(
+    const SampleMatrix &samples, int begin, int end) const {
+    int num_samples = end - begin;
+    int num_pdbs = pdbs.size();
+    // pdb_values[pdb_id * num_samples + i] is the value of sample begin + i.
+    vector<int> pdb_values(num_pdbs * num_samples);
+    vector<int> indices(num_samples);
+    for (int pdb_id = 0; pdb_id < num_pdbs; ++pdb_id) {
+        const Projection &projection = pdbs[pdb_id]->get_projection();
+        const Pattern &pattern = projection.get_pattern();
+        const vector<int> &multipliers = projection.get_perfect_hash_multipliers();
+        if (projection.is_domain_abstraction()) {
+            for (int i = 0; i < num_samples; ++i) {
+                indices[i] = projection.rank_original_state(samples[begin + i]);
+            }
+        } else {
+            fill(indices.begin(), indices.end(), 0);
+            for (size_t i = 0; i < pattern.size(); ++i) {
+                samples.add_to_indices(pattern[i], multipliers[i], begin, end, indices.data());
+            }
+        }
+        int *values = pdb_values.data() + pdb_id * num_samples;
+        for (int i = 0; i < num_samples; ++i) {
+            values[i] = pdbs[pdb_id]->lookup_index(indices[i]);
+        }
+    }
+
+    vector<int> heuristic_values(num_pdbs);
+    vector<int> result;
+    result.reserve(num_samples);
+    for (int i = 0; i < num_samples; ++i) {
+        bool dead_end = false;
+        for (int pdb_id = 0; pdb_id < num_pdbs; ++pdb_id) {
+            heuristic_values[pdb_id] = pdb_values[pdb_id * num_samples + i];
+            if (heuristic_values[pdb_id] == numeric_limits<int>::max()) {
+                dead_end = true;
+                break;
+            }
+        }
+        if (dead_end) {
+            result.push_back(numeric_limits<int>::max());
+        } else {
+            result.push_back(compute_max_over_cliques(heuristic_values));
+        }
+    }
+    return result;
+}
+
+int CanonicalPatternDatabases::compute_max_over_cliques(const vector<int> &heuristic_values) const {
     /*
       Use maximal_additive_sets and heuristic_values to compute the value
       of the canonical heuristic.
@@ -101,7 +343,7 @@ int CanonicalPatternDatabases::compute_heuristic(const TNFState &original_state)
     // TODO: add your code for exercise (d) here.
     int max = numeric_limits<int>::min(); 
     int clique_value;
-    for(vector<int> clique : maximal_additive_sets){
+    for(const vector<int> &clique : maximal_additive_sets){
         clique_value = 0;
         for(unsigned int i = 0; i < clique.size();i++){
             clique_value += heuristic_values[clique[i]];
@@ -114,10 +356,4 @@ int CanonicalPatternDatabases::compute_heuristic(const TNFState &original_state)
 
     return h;
 }
-
-
-
-
-
-
 }
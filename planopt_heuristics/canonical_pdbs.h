@@ -2,18 +2,192 @@
 #define PLANOPT_HEURISTICS_CANONICAL_PDBS_H
 
 #include "pdb.h"
+#include "sample_matrix.h"
 
+#include <limits>
 #include <vector>
 
 namespace planopt_heuristics {
+/*
+  Adjacency lists of the compatibility graph of the patterns: pattern j is
+  a neighbor of pattern i if the two patterns are additive.
+*/
+extern std::vector<std::vector<int>> build_compatibility_graph(
+    const std::vector<Pattern> &patterns, const TNFTask &task);
+
+/*
+  Change of the abstract index of one PDB caused by one operator. If the
+  operator has no precondition on variable var_id, the change depends on the
+  value of var_id in the parent state: delta + multiplier * parent[var_id].
+  Otherwise var_id is -1 and delta is the complete change.
+*/
+struct AbstractIndexUpdate {
+    int pdb_id;
+    int delta;
+    int var_id;
+    int multiplier;
+    // Maps the parent's value to an abstract value for domain abstractions.
+    const ValueMapping *value_mapping;
+
+    AbstractIndexUpdate(int pdb_id, int delta, int var_id, int multiplier,
+                        const ValueMapping *value_mapping = nullptr)
+        : pdb_id(pdb_id), delta(delta), var_id(var_id), multiplier(multiplier),
+          value_mapping(value_mapping) {
+    }
+};
 
 class CanonicalPatternDatabases {
-    std::vector<PatternDatabase> pdbs;
+    PDBCollection pdbs;
     std::vector<std::vector<int>> maximal_additive_sets;
+
+    /*
+      PDBs with dead states, ordered by decreasing fraction of dead states.
+      Checking their dead-state bitmaps in this order rejects most dead ends
+      after few memory accesses.
+    */
+    std::vector<int> dead_end_order;
+
+    bool has_dead_index(const std::vector<int> &indices) const {
+        for (int pdb_id : dead_end_order) {
+            if (pdbs[pdb_id]->is_dead_index(indices[pdb_id])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Indexed by operator id, only filled by prepare_incremental_indices().
+    std::vector<std::vector<AbstractIndexUpdate>> index_updates;
+
+    /*
+      Clique pruning (see enable_clique_pruning()). The statistics are
+      updated by the const evaluation methods.
+    */
+    int clique_pruning_warm_up;
+    mutable int num_evaluations;
+    mutable bool cliques_pruned;
+    /*
+      Number of evaluations in which a clique was the first maximal clique.
+      The counts continue after the warm-up for the final statistics.
+    */
+    mutable std::vector<int> clique_wins;
+    // Number of evaluations in which a PDB belonged to the winning clique.
+    mutable std::vector<int> pdb_contributions;
+    // Cliques that are evaluated and the PDBs that occur in them.
+    mutable std::vector<int> active_cliques;
+    mutable std::vector<int> active_pdbs;
+
+    /*
+      Buffer for the values of one evaluation, reused to avoid allocations.
+      Like the clique pruning statistics, it is modified by the const
+      evaluation methods, so a collection must only be evaluated by one
+      thread at a time.
+    */
+    mutable std::vector<int> scratch_values;
+
+    int compute_max_over_active_cliques(const std::vector<int> &heuristic_values) const;
+    void prune_cliques() const;
+
+    int compute_max_over_cliques(const std::vector<int> &heuristic_values) const;
+    /*
+      Replace the indices of the active PDBs by their heuristic values and
+      combine them. The table entries should already be prefetched.
+    */
+    int compute_heuristic_from_prefetched_indices(std::vector<int> &values) const;
 public:
     CanonicalPatternDatabases(const TNFTask &task, const std::vector<Pattern> &patterns);
+    CanonicalPatternDatabases(const TNFTask &task, PDBCollection pattern_databases);
+
+    template<typename State>
+    int compute_heuristic(const State &original_state) const {
+        /*
+          To avoid the overhead of looking up the heuristic value of a PDB
+          multiple times (if that PDB occurs in multiple cliques), we
+          pre-compute all heuristic values. We first compute all indices and
+          check the small dead-state bitmaps, so dead ends never touch the
+          distance tables. For other states, we prefetch the table entries, so
+          the lookups into the different tables overlap instead of waiting for
+          each other.
+        */
+        std::vector<int> &heuristic_values = scratch_values;
+        heuristic_values.resize(pdbs.size());
+        for (size_t i = 0; i < pdbs.size(); ++i) {
+            heuristic_values[i] = pdbs[i]->compute_index(original_state);
+        }
+        if (has_dead_index(heuristic_values)) {
+            return std::numeric_limits<int>::max();
+        }
+        for (int pdb_id : active_pdbs) {
+            pdbs[pdb_id]->prefetch_index(heuristic_values[pdb_id]);
+        }
+        return compute_heuristic_from_prefetched_indices(heuristic_values);
+    }
+
+    /*
+      Compute the heuristic values of the samples in [begin, end). The
+      abstract indices are computed PDB by PDB so that each pass streams
+      through the columns of the pattern variables.
+    */
+    std::vector<int> compute_heuristics(
+        const SampleMatrix &samples, int begin, int end) const;
+
+    /*
+      Support for computing the abstract indices of a successor state from the
+      indices of its parent: prepare_incremental_indices() precomputes for each
+      operator of the SAS+ task how it changes the indices of the PDBs whose
+      pattern it affects.
+    */
+    void prepare_incremental_indices(const TNFTask &task);
+    void compute_abstract_indices(
+        const TNFState &original_state, std::vector<int> &indices) const;
+    template<typename State>
+    void compute_successor_indices(
+        const std::vector<int> &parent_indices, const State &parent_state,
+        int op_id, std::vector<int> &indices) const {
+        indices = parent_indices;
+        for (const AbstractIndexUpdate &update : index_updates[op_id]) {
+            int delta = update.delta;
+            if (update.var_id != -1) {
+                int parent_value = parent_state[update.var_id];
+                if (update.value_mapping) {
+                    parent_value = (*update.value_mapping)[parent_value];
+                }
+                delta -= update.multiplier * parent_value;
+            }
+            indices[update.pdb_id] += delta;
+        }
+    }
+    int compute_heuristic_from_indices(const std::vector<int> &indices) const;
+
+    const PDBCollection &get_pdbs() const {
+        return pdbs;
+    }
+
+    /*
+      Count how often each clique is the maximal one during the first
+      warm_up evaluations. Afterwards, only cliques that were maximal at
+      least once are evaluated and PDBs that only occur in other cliques are
+      no longer looked up. The maximum over a subset of the cliques is still
+      admissible. Dead-end detection keeps using all PDBs.
+    */
+    void enable_clique_pruning(int warm_up);
+    /*
+      Log how many cliques and PDBs are still evaluated and the cliques and
+      PDBs that were maximal most often. Does nothing without clique pruning.
+    */
+    void print_clique_pruning_statistics() const;
 
-    int compute_heuristic(const TNFState &original_state);
+    // True if one of the PDBs recognizes the state as a dead end.
+    template<typename State>
+    bool is_dead_end(const State &original_state) const {
+        for (int pdb_id : dead_end_order) {
+            const PatternDatabase &pdb = *pdbs[pdb_id];
+            if (pdb.is_dead_index(pdb.compute_index(original_state))) {
+                return true;
+            }
+        }
+        return false;
+    }
 };
 }
 
@@ -0,0 +1,223 @@
+#include "cegar_patterns.h"
+
+#include "thread_log.h"
+
+#include "../utils/countdown_timer.h"
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
+using namespace std;
+
+namespace planopt_heuristics {
+namespace {
+struct CEGARPattern {
+    Pattern pattern;
+    shared_ptr<PatternDatabase> pdb;
+    bool finished = false;
+    // Set if the pattern was merged into another one.
+    bool removed = false;
+};
+}
+
+static double compute_num_abstract_states(const TNFTask &task, const Pattern &pattern) {
+    double num_states = 1;
+    for (int var_id : pattern) {
+        num_states *= task.variable_domains[var_id];
+    }
+    return num_states;
+}
+
+/*
+  Store an optimal plan of the projection from the projected initial state
+  in plan, as a sequence of operator ids of the original task. The search
+  only follows transitions s -o-> t with cost(o) + h(t) = h(s), so the first
+  path to the goal found by breadth-first search is optimal. Returns false if
+  the projected initial state is a dead end.
+*/
+static bool extract_abstract_plan(const PatternDatabase &pdb, vector<int> &plan) {
+    const Projection &projection = pdb.get_projection();
+    const TNFTask &projected_task = projection.get_projected_task();
+    int initial_index = projection.rank_state(projected_task.initial_state);
+    int goal_index = projection.rank_state(projected_task.goal_state);
+    if (pdb.lookup_index(initial_index) == numeric_limits<int>::max()) {
+        return false;
+    }
+
+    // Predecessor and projected operator of each reached abstract state.
+    unordered_map<int, pair<int, int>> parents;
+    parents[initial_index] = make_pair(-1, -1);
+    deque<int> queue = {initial_index};
+    while (!queue.empty() && !parents.count(goal_index)) {
+        int index = queue.front();
+        queue.pop_front();
+        TNFState state = projection.unrank_state(index);
+        int h = pdb.lookup_index(index);
+        for (size_t op_id = 0; op_id < projected_task.operators.size(); ++op_id) {
+            const TNFOperator &op = projected_task.operators[op_id];
+            TNFState successor(state);
+            bool applicable = true;
+            for (const TNFOperatorEntry &entry : op.entries) {
+                if (state[entry.variable_id] != entry.precondition_value) {
+                    applicable = false;
+                    break;
+                }
+                successor[entry.variable_id] = entry.effect_value;
+            }
+            if (!applicable) {
+                continue;
+            }
+            int successor_index = projection.rank_state(successor);
+            int successor_h = pdb.lookup_index(successor_index);
+            if (successor_h == numeric_limits<int>::max() ||
+                op.cost + successor_h != h || parents.count(successor_index)) {
+                continue;
+            }
+            parents[successor_index] = make_pair(index, op_id);
+            queue.push_back(successor_index);
+        }
+    }
+    if (!parents.count(goal_index)) {
+        return false;
+    }
+
+    const vector<int> &operator_ids = projection.get_operator_ids();
+    plan.clear();
+    for (int index = goal_index; parents[index].first != -1; index = parents[index].first) {
+        plan.push_back(operator_ids[parents[index].second]);
+    }
+    reverse(plan.begin(), plan.end());
+    return true;
+}
+
+/*
+  Execute the plan in the original task from the initial state and return
+  the first variable whose precondition or goal value does not hold, or -1 if
+  the plan solves the task. Preconditions on the unknown value and unknown
+  goal values always hold, since variables can be forgotten at no cost.
+*/
+static int find_flaw(const TNFTask &task, const vector<int> &plan) {
+    TNFState state = task.initial_state;
+    for (int op_id : plan) {
+        const TNFOperator &op = task.operators[op_id];
+        for (const TNFOperatorEntry &entry : op.entries) {
+            int var = entry.variable_id;
+            if (state[var] != entry.precondition_value &&
+                !task.is_unknown_value(var, entry.precondition_value)) {
+                return var;
+            }
+        }
+        for (const TNFOperatorEntry &entry : op.entries) {
+            state[entry.variable_id] = entry.effect_value;
+        }
+    }
+    for (size_t var = 0; var < state.size(); ++var) {
+        int goal_value = task.goal_state[var];
+        if (state[var] != goal_value && !task.is_unknown_value(var, goal_value)) {
+            return var;
+        }
+    }
+    return -1;
+}
+
+PDBCollection generate_pdbs_by_cegar(
+    const TNFTask &task, int size_bound, double max_time, const PDBOptions &pdb_options,
+    const atomic<bool> *interrupted) {
+    utils::CountdownTimer timer(max_time);
+    auto should_stop = [&timer, interrupted]() {
+        return timer.is_expired() || (interrupted && *interrupted);
+    };
+    int num_variables = task.variable_domains.size();
+    vector<CEGARPattern> patterns;
+    vector<int> pattern_of_variable(num_variables, -1);
+    double collection_size = 0;
+    for (int var = 0; var < num_variables; ++var) {
+        if (!task.is_unknown_value(var, task.goal_state[var])) {
+            pattern_of_variable[var] = patterns.size();
+            CEGARPattern goal_pattern;
+            goal_pattern.pattern = {var};
+            goal_pattern.pdb = make_shared<PatternDatabase>(
+                Projection(task, goal_pattern.pattern), pdb_options);
+            patterns.push_back(move(goal_pattern));
+            collection_size += task.variable_domains[var];
+        }
+    }
+    int num_pdb_builds = patterns.size();
+
+    bool done = false;
+    bool refined = true;
+    while (!done && refined && !should_stop()) {
+        refined = false;
+        for (size_t i = 0; i < patterns.size() && !done && !should_stop(); ++i) {
+            CEGARPattern &current = patterns[i];
+            if (current.finished || current.removed) {
+                continue;
+            }
+            vector<int> plan;
+            if (!extract_abstract_plan(*current.pdb, plan)) {
+                thread_log << "CEGAR: the initial state is a dead end" << endl;
+                done = true;
+                break;
+            }
+            int flaw_variable = find_flaw(task, plan);
+            if (flaw_variable == -1) {
+                thread_log << "CEGAR: abstract plan solves the task" << endl;
+                done = true;
+                break;
+            }
+
+            int other_id = pattern_of_variable[flaw_variable];
+            if (other_id == static_cast<int>(i)) {
+                // Cannot happen for plans of the projection, but avoids looping.
+                current.finished = true;
+                continue;
+            }
+            Pattern new_pattern = current.pattern;
+            double new_size = collection_size -
+                compute_num_abstract_states(task, current.pattern);
+            if (other_id == -1) {
+                new_pattern.push_back(flaw_variable);
+            } else {
+                const Pattern &other_pattern = patterns[other_id].pattern;
+                new_pattern.insert(new_pattern.end(), other_pattern.begin(), other_pattern.end());
+                new_size -= compute_num_abstract_states(task, other_pattern);
+            }
+            sort(new_pattern.begin(), new_pattern.end());
+            new_size += compute_num_abstract_states(task, new_pattern);
+            if (new_size > size_bound) {
+                current.finished = true;
+                continue;
+            }
+
+            current.pdb = make_shared<PatternDatabase>(
+                Projection(task, new_pattern), pdb_options);
+            current.pattern = move(new_pattern);
+            ++num_pdb_builds;
+            if (other_id != -1) {
+                patterns[other_id].removed = true;
+                patterns[other_id].pdb = nullptr;
+            }
+            for (int var : current.pattern) {
+                pattern_of_variable[var] = i;
+            }
+            collection_size = new_size;
+            refined = true;
+        }
+    }
+    if (should_stop()) {
+        thread_log << "CEGAR: time limit reached or interrupted" << endl;
+    }
+
+    PDBCollection pdbs;
+    for (const CEGARPattern &cegar_pattern : patterns) {
+        if (!cegar_pattern.removed) {
+            pdbs.push_back(cegar_pattern.pdb);
+        }
+    }
+    thread_log << "CEGAR selected " << pdbs.size() << " patterns with "
+          << collection_size << " abstract states using " << num_pdb_builds
+          << " PDB builds" << endl;
+    return pdbs;
+}
+}
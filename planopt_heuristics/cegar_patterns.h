@@ -0,0 +1,29 @@
+#ifndef PLANOPT_HEURISTICS_CEGAR_PATTERNS_H
+#define PLANOPT_HEURISTICS_CEGAR_PATTERNS_H
+
+#include "pdb.h"
+
+#include <atomic>
+#include <limits>
+
+namespace planopt_heuristics {
+/*
+  Counterexample-guided pattern selection. Every goal variable starts with
+  its own pattern. An optimal abstract plan of each pattern is executed in
+  the original task from the initial state, and the first variable whose
+  precondition or goal value is violated is added to the pattern. If the
+  variable already belongs to another pattern, the two patterns are merged.
+  A pattern is finished when its refinement would exceed size_bound
+  abstract states in total. Selection stops when all patterns are finished,
+  an abstract plan solves the original task, max_time is reached or
+  *interrupted becomes true. The result contains the PDBs built for the
+  final patterns.
+*/
+extern PDBCollection generate_pdbs_by_cegar(
+    const TNFTask &task, int size_bound,
+    double max_time = std::numeric_limits<double>::infinity(),
+    const PDBOptions &pdb_options = PDBOptions(),
+    const std::atomic<bool> *interrupted = nullptr);
+}
+
+#endif
@@ -0,0 +1,354 @@
+#include "external_memory.h"
+
+#include "../utils/memory.h"
+#include "../utils/system.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <queue>
+
+#ifdef PLANOPT_HEURISTICS_HAS_POSIX_IO
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace planopt_heuristics {
+#ifdef PLANOPT_HEURISTICS_HAS_POSIX_IO
+static void write_fully(int fd, const void *data, size_t num_bytes, IOStatistics &statistics) {
+    const char *bytes = static_cast<const char *>(data);
+    while (num_bytes > 0) {
+        ssize_t written = write(fd, bytes, num_bytes);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ABORT(string("Writing to disk failed: ") + strerror(errno));
+        }
+        bytes += written;
+        num_bytes -= written;
+        statistics.bytes_written += written;
+    }
+}
+
+// Read up to num_bytes bytes at offset and return the number of bytes read.
+static size_t read_at(int fd, void *data, size_t num_bytes, int64_t offset,
+                      IOStatistics &statistics) {
+    char *bytes = static_cast<char *>(data);
+    size_t total = 0;
+    while (total < num_bytes) {
+        ssize_t num_read = pread(fd, bytes + total, num_bytes - total, offset + total);
+        if (num_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ABORT(string("Reading from disk failed: ") + strerror(errno));
+        }
+        if (num_read == 0) {
+            break;
+        }
+        total += num_read;
+    }
+    statistics.bytes_read += total;
+    return total;
+}
+
+static int open_file(const string &path, int flags) {
+    int fd = open(path.c_str(), flags, 0600);
+    if (fd < 0) {
+        ABORT("Could not open " + path + ": " + strerror(errno));
+    }
+    return fd;
+}
+
+IntFileWriter::IntFileWriter(
+    const string &path, size_t buffer_size, IOStatistics &statistics, bool append)
+    : path(path),
+      fd(open_file(path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC))),
+      statistics(statistics) {
+    buffer.reserve(max<size_t>(buffer_size, 1));
+}
+
+IntFileWriter::~IntFileWriter() {
+    flush();
+    close(fd);
+}
+
+void IntFileWriter::flush() {
+    write_fully(fd, buffer.data(), buffer.size() * sizeof(int), statistics);
+    buffer.clear();
+}
+
+IntFileReader::IntFileReader(
+    const string &path, size_t buffer_size, IOStatistics &statistics)
+    : fd(open_file(path, O_RDONLY)),
+      position(0),
+      statistics(statistics) {
+    buffer.reserve(max<size_t>(buffer_size, 1));
+}
+
+IntFileReader::~IntFileReader() {
+    close(fd);
+}
+
+bool IntFileReader::fill_buffer() {
+    buffer.resize(buffer.capacity());
+    size_t num_bytes = 0;
+    while (num_bytes < buffer.size() * sizeof(int)) {
+        ssize_t num_read = read(fd, reinterpret_cast<char *>(buffer.data()) + num_bytes,
+                                buffer.size() * sizeof(int) - num_bytes);
+        if (num_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ABORT(string("Reading from disk failed: ") + strerror(errno));
+        }
+        if (num_read == 0) {
+            break;
+        }
+        num_bytes += num_read;
+    }
+    statistics.bytes_read += num_bytes;
+    buffer.resize(num_bytes / sizeof(int));
+    position = 0;
+    return !buffer.empty();
+}
+
+IntFileSweeper::IntFileSweeper(
+    const string &path, size_t block_size, IOStatistics &statistics)
+    : fd(open_file(path, O_RDWR)),
+      block_start(0),
+      block_dirty(false),
+      statistics(statistics) {
+    block.reserve(max<size_t>(block_size, 1));
+}
+
+IntFileSweeper::~IntFileSweeper() {
+    write_back();
+    close(fd);
+}
+
+void IntFileSweeper::write_back() {
+    if (!block_dirty) {
+        return;
+    }
+    size_t num_bytes = block.size() * sizeof(int);
+    const char *bytes = reinterpret_cast<const char *>(block.data());
+    int64_t offset = block_start * sizeof(int);
+    size_t total = 0;
+    while (total < num_bytes) {
+        ssize_t written = pwrite(fd, bytes + total, num_bytes - total, offset + total);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ABORT(string("Writing to disk failed: ") + strerror(errno));
+        }
+        total += written;
+    }
+    statistics.bytes_written += total;
+    block_dirty = false;
+}
+
+void IntFileSweeper::load_block(int64_t index) {
+    write_back();
+    int64_t block_size = block.capacity();
+    block_start = index / block_size * block_size;
+    block.resize(block_size);
+    size_t num_bytes = read_at(fd, block.data(), block_size * sizeof(int),
+                               block_start * sizeof(int), statistics);
+    block.resize(num_bytes / sizeof(int));
+    if (index >= block_start + static_cast<int64_t>(block.size())) {
+        ABORT("Access beyond the end of an external array");
+    }
+}
+
+MappedIntArray::MappedIntArray(const string &path, size_t num_entries)
+    : address(nullptr),
+      num_bytes(num_entries * sizeof(int)) {
+    if (num_bytes == 0) {
+        return;
+    }
+    int fd = open_file(path, O_RDONLY);
+    address = mmap(nullptr, num_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        ABORT("Could not map " + path + ": " + strerror(errno));
+    }
+}
+
+MappedIntArray::~MappedIntArray() {
+    if (address) {
+        munmap(address, num_bytes);
+    }
+}
+
+string create_temporary_directory(const string &parent_directory) {
+    string pattern = parent_directory + "/pdb-XXXXXX";
+    vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    if (!mkdtemp(path.data())) {
+        ABORT("Could not create a directory in " + parent_directory + ": " +
+              strerror(errno));
+    }
+    return string(path.data());
+}
+
+string create_temporary_file(const string &prefix) {
+    string pattern = prefix + "XXXXXX";
+    vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    int fd = mkstemp(path.data());
+    if (fd < 0) {
+        return string();
+    }
+    close(fd);
+    return string(path.data());
+}
+
+void remove_file(const string &path) {
+    unlink(path.c_str());
+}
+
+void remove_directory(const string &path) {
+    rmdir(path.c_str());
+}
+#else
+static void abort_without_posix_io() {
+    ABORT("External memory is only supported on POSIX systems");
+}
+
+IntFileWriter::IntFileWriter(
+    const string &path, size_t, IOStatistics &statistics, bool)
+    : path(path), fd(-1), statistics(statistics) {
+    abort_without_posix_io();
+}
+
+IntFileWriter::~IntFileWriter() {
+}
+
+void IntFileWriter::flush() {
+}
+
+IntFileReader::IntFileReader(const string &, size_t, IOStatistics &statistics)
+    : fd(-1), position(0), statistics(statistics) {
+    abort_without_posix_io();
+}
+
+IntFileReader::~IntFileReader() {
+}
+
+bool IntFileReader::fill_buffer() {
+    return false;
+}
+
+IntFileSweeper::IntFileSweeper(const string &, size_t, IOStatistics &statistics)
+    : fd(-1), block_start(0), block_dirty(false), statistics(statistics) {
+    abort_without_posix_io();
+}
+
+IntFileSweeper::~IntFileSweeper() {
+}
+
+void IntFileSweeper::write_back() {
+}
+
+void IntFileSweeper::load_block(int64_t) {
+}
+
+MappedIntArray::MappedIntArray(const string &, size_t)
+    : address(nullptr), num_bytes(0) {
+    abort_without_posix_io();
+}
+
+MappedIntArray::~MappedIntArray() {
+}
+
+string create_temporary_directory(const string &) {
+    abort_without_posix_io();
+    return string();
+}
+
+string create_temporary_file(const string &) {
+    return string();
+}
+
+void remove_file(const string &) {
+    abort_without_posix_io();
+}
+
+void remove_directory(const string &) {
+    abort_without_posix_io();
+}
+#endif
+
+vector<string> create_sorted_runs(
+    const string &path, size_t run_size, IOStatistics &statistics) {
+    vector<string> runs;
+    {
+        IntFileReader reader(path, run_size, statistics);
+        vector<int> run;
+        run.reserve(run_size);
+        int value;
+        bool has_more = true;
+        while (has_more) {
+            run.clear();
+            while (run.size() < run_size && (has_more = reader.next(value))) {
+                run.push_back(value);
+            }
+            if (run.empty()) {
+                break;
+            }
+            sort(run.begin(), run.end());
+            run.erase(unique(run.begin(), run.end()), run.end());
+            runs.push_back(path + "." + to_string(runs.size()));
+            IntFileWriter writer(runs.back(), run.size(), statistics);
+            for (int sorted_value : run) {
+                writer.append(sorted_value);
+            }
+        }
+    }
+    remove_file(path);
+    return runs;
+}
+
+void merge_sorted_runs(
+    const vector<string> &runs, size_t buffer_size, IOStatistics &statistics,
+    const function<void(int)> &callback) {
+    using Entry = pair<int, int>;
+    vector<unique_ptr<IntFileReader>> readers;
+    priority_queue<Entry, vector<Entry>, greater<Entry>> heads;
+    for (const string &run : runs) {
+        readers.push_back(utils::make_unique_ptr<IntFileReader>(run, buffer_size, statistics));
+        int value;
+        if (readers.back()->next(value)) {
+            heads.emplace(value, readers.size() - 1);
+        }
+    }
+    bool has_last = false;
+    int last = 0;
+    while (!heads.empty()) {
+        Entry head = heads.top();
+        heads.pop();
+        if (!has_last || head.first != last) {
+            callback(head.first);
+            last = head.first;
+            has_last = true;
+        }
+        int value;
+        if (readers[head.second]->next(value)) {
+            heads.emplace(value, head.second);
+        }
+    }
+    readers.clear();
+    for (const string &run : runs) {
+        remove_file(run);
+    }
+}
+}
@@ -0,0 +1,167 @@
+#ifndef PLANOPT_HEURISTICS_EXTERNAL_MEMORY_H
+#define PLANOPT_HEURISTICS_EXTERNAL_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PLANOPT_HEURISTICS_HAS_POSIX_IO
+#endif
+
+/*
+  The classes and functions below use POSIX file I/O. On other platforms,
+  they abort with an error message.
+*/
+namespace planopt_heuristics {
+// I/O volume of an external-memory algorithm in bytes.
+struct IOStatistics {
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+};
+
+/*
+  Sequentially written file of ints. Values are collected in a buffer and
+  written in large blocks. With append, the values are added to the end of
+  an existing file instead of replacing its contents.
+*/
+class IntFileWriter {
+    std::string path;
+    int fd;
+    std::vector<int> buffer;
+    IOStatistics &statistics;
+public:
+    IntFileWriter(const std::string &path, std::size_t buffer_size,
+                  IOStatistics &statistics, bool append = false);
+    // Closes the file, but keeps it on disk.
+    ~IntFileWriter();
+
+    IntFileWriter(const IntFileWriter &) = delete;
+    IntFileWriter &operator=(const IntFileWriter &) = delete;
+
+    void append(int value) {
+        buffer.push_back(value);
+        if (buffer.size() == buffer.capacity()) {
+            flush();
+        }
+    }
+    void flush();
+
+    const std::string &get_path() const {
+        return path;
+    }
+};
+
+// Sequentially read file of ints.
+class IntFileReader {
+    int fd;
+    std::vector<int> buffer;
+    std::size_t position;
+    IOStatistics &statistics;
+
+    bool fill_buffer();
+public:
+    IntFileReader(const std::string &path, std::size_t buffer_size,
+                  IOStatistics &statistics);
+    ~IntFileReader();
+
+    IntFileReader(const IntFileReader &) = delete;
+    IntFileReader &operator=(const IntFileReader &) = delete;
+
+    // Read the next value into value. Returns false at the end of the file.
+    bool next(int &value) {
+        if (position == buffer.size() && !fill_buffer()) {
+            return false;
+        }
+        value = buffer[position++];
+        return true;
+    }
+};
+
+/*
+  Array of ints in a file that is accessed in increasing order of indices.
+  Blocks of the file are read on demand and written back when the access
+  moves past them.
+*/
+class IntFileSweeper {
+    int fd;
+    std::vector<int> block;
+    int64_t block_start;
+    bool block_dirty;
+    IOStatistics &statistics;
+
+    void load_block(int64_t index);
+    void write_back();
+public:
+    IntFileSweeper(const std::string &path, std::size_t block_size,
+                   IOStatistics &statistics);
+    // Writes back the last block and closes the file.
+    ~IntFileSweeper();
+
+    IntFileSweeper(const IntFileSweeper &) = delete;
+    IntFileSweeper &operator=(const IntFileSweeper &) = delete;
+
+    int &operator[](int64_t index) {
+        if (index < block_start ||
+            index >= block_start + static_cast<int64_t>(block.size())) {
+            load_block(index);
+        }
+        return block[index - block_start];
+    }
+    void mark_dirty() {
+        block_dirty = true;
+    }
+};
+
+// Read-only memory mapping of a file of ints.
+class MappedIntArray {
+    void *address;
+    std::size_t num_bytes;
+public:
+    /*
+      Map the first num_entries ints of the file. The file can be removed
+      afterwards; the mapping stays valid until destruction.
+    */
+    MappedIntArray(const std::string &path, std::size_t num_entries);
+    ~MappedIntArray();
+
+    MappedIntArray(const MappedIntArray &) = delete;
+    MappedIntArray &operator=(const MappedIntArray &) = delete;
+
+    const int *data() const {
+        return static_cast<const int *>(address);
+    }
+};
+
+// Create a new directory with a unique name in the given directory.
+extern std::string create_temporary_directory(const std::string &parent_directory);
+/*
+  Create a new empty file whose name consists of the prefix and a unique
+  suffix. Returns its path or an empty string on failure (always on platforms
+  without POSIX I/O), so callers can treat the file as optional.
+*/
+extern std::string create_temporary_file(const std::string &prefix);
+extern void remove_file(const std::string &path);
+// Remove an empty directory.
+extern void remove_directory(const std::string &path);
+
+/*
+  Sort the ints of the file in runs of at most run_size values, remove
+  duplicates within each run and write each run to its own file next to the
+  input file. The input file is removed. Returns the paths of the runs.
+*/
+extern std::vector<std::string> create_sorted_runs(
+    const std::string &path, std::size_t run_size, IOStatistics &statistics);
+
+/*
+  Merge sorted runs and call callback for each distinct value in increasing
+  order. The runs are removed afterwards.
+*/
+extern void merge_sorted_runs(
+    const std::vector<std::string> &runs, std::size_t buffer_size,
+    IOStatistics &statistics, const std::function<void(int)> &callback);
+}
+
+#endif
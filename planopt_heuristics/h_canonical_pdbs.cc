@@ -1,30 +1,84 @@
 #include "h_canonical_pdbs.h"
 
+#include "thread_log.h"
+
 #include "../option_parser.h"
 #include "../plugin.h"
 
+#include "../utils/memory.h"
+
+#include <algorithm>
+
 using namespace std;
 
 namespace planopt_heuristics {
 CanonicalPDBsHeuristic::CanonicalPDBsHeuristic(const options::Options &options)
-    : Heuristic(options),
-      pdbs(create_tnf_task(task_proxy), options.get_list<vector<int>>("patterns")) {
-}
-
-int CanonicalPDBsHeuristic::compute_heuristic(const GlobalState &global_state) {
-    TNFState state = global_state.get_values();
-
-    int h = pdbs.compute_heuristic(state);
-    if (h == numeric_limits<int>::max()) {
-        return DEAD_END;
+    : PDBCollectionHeuristic(options) {
+    vector<Pattern> patterns = options.get_list<vector<int>>("patterns");
+    int max_domain_size = options.get<int>("max_domain_size");
+    PDBOptions pdb_options = get_pdb_options(options);
+    if (options.get<bool>("background_construction")) {
+        set_cpdbs(utils::make_unique_ptr<CanonicalPatternDatabases>(
+                      tnf_task, get_goal_variable_singletons(task_proxy)));
+        const TNFTask &task = tnf_task;
+        PDBCollection goal_pdbs = cpdbs.get()->get_pdbs();
+        start_background_construction(
+            [this, &task, patterns, max_domain_size, pdb_options, goal_pdbs](
+                const atomic<bool> &interrupted)
+            -> unique_ptr<CanonicalPatternDatabases> {
+                /*
+                  Build the PDBs in batches of doubling size. After every
+                  batch but the last, the PDBs built so far are swapped in
+                  together with the goal variable singletons. Doubling the
+                  batches keeps the number of clique computations
+                  logarithmic in the number of patterns.
+                */
+                PDBCollection pdbs;
+                size_t batch_size = 1;
+                while (pdbs.size() < patterns.size()) {
+                    size_t end = min(patterns.size(), pdbs.size() + batch_size);
+                    vector<Pattern> batch(patterns.begin() + pdbs.size(),
+                                          patterns.begin() + end);
+                    PDBCollection batch_pdbs = build_pattern_databases(
+                        task, batch, 1, max_domain_size, pdb_options,
+                        &interrupted);
+                    if (interrupted) {
+                        return nullptr;
+                    }
+                    pdbs.insert(pdbs.end(), batch_pdbs.begin(), batch_pdbs.end());
+                    batch_size *= 2;
+                    if (pdbs.size() < patterns.size()) {
+                        PDBCollection partial_pdbs = goal_pdbs;
+                        partial_pdbs.insert(
+                            partial_pdbs.end(), pdbs.begin(), pdbs.end());
+                        set_cpdbs(utils::make_unique_ptr<CanonicalPatternDatabases>(
+                                      task, partial_pdbs));
+                        thread_log << "Swapped in " << pdbs.size() << " of "
+                                   << patterns.size()
+                                   << " PDBs built in the background" << endl;
+                    }
+                }
+                return utils::make_unique_ptr<CanonicalPatternDatabases>(
+                    task, pdbs);
+            });
     } else {
-        return h;
+        set_cpdbs(utils::make_unique_ptr<CanonicalPatternDatabases>(
+                      tnf_task, build_pattern_databases(
+                          tnf_task, patterns, 1, max_domain_size,
+                          pdb_options)));
     }
 }
 
 static Heuristic *_parse(OptionParser &parser) {
-    Heuristic::add_options_to_parser(parser);
+    PDBCollectionHeuristic::add_options_to_parser(parser);
     parser.add_list_option<vector<int>>("patterns");
+    parser.add_option<int>(
+        "max_domain_size",
+        "map the values of variables with larger domains to this many "
+        "abstract values (domain abstraction)",
+        "infinity",
+        Bounds("2", "infinity"));
+    add_pdb_options_to_parser(parser);
     Options opts = parser.parse();
     if (parser.dry_run())
         return nullptr;
@@ -0,0 +1,57 @@
+#include "h_cegar_pdbs.h"
+
+#include "cegar_patterns.h"
+
+#include "../option_parser.h"
+#include "../plugin.h"
+
+#include "../utils/memory.h"
+
+using namespace std;
+
+namespace planopt_heuristics {
+CEGARPDBsHeuristic::CEGARPDBsHeuristic(const options::Options &options)
+    : PDBCollectionHeuristic(options) {
+    int size_bound = options.get<int>("size_bound");
+    double max_time = options.get<double>("max_time");
+    PDBOptions pdb_options = get_pdb_options(options);
+    if (options.get<bool>("background_construction")) {
+        set_cpdbs(utils::make_unique_ptr<CanonicalPatternDatabases>(
+                      tnf_task, get_goal_variable_singletons(task_proxy)));
+        const TNFTask &task = tnf_task;
+        start_background_construction(
+            [&task, size_bound, max_time, pdb_options](const atomic<bool> &interrupted)
+            -> unique_ptr<CanonicalPatternDatabases> {
+                PDBCollection pdbs = generate_pdbs_by_cegar(
+                    task, size_bound, max_time, pdb_options, &interrupted);
+                if (interrupted) {
+                    return nullptr;
+                }
+                return utils::make_unique_ptr<CanonicalPatternDatabases>(task, pdbs);
+            });
+    } else {
+        set_cpdbs(utils::make_unique_ptr<CanonicalPatternDatabases>(
+                      tnf_task, generate_pdbs_by_cegar(
+                          tnf_task, size_bound, max_time, pdb_options)));
+    }
+}
+
+static Heuristic *_parse(OptionParser &parser) {
+    PDBCollectionHeuristic::add_options_to_parser(parser);
+    parser.add_option<int>("size_bound");
+    parser.add_option<double>(
+        "max_time",
+        "maximum time in seconds for the pattern selection",
+        "infinity",
+        Bounds("0.0", "infinity"));
+    add_pdb_options_to_parser(parser);
+    Options opts = parser.parse();
+    if (parser.dry_run())
+        return nullptr;
+    else
+        return new CEGARPDBsHeuristic(opts);
+}
+
+static Plugin<Heuristic> _plugin("planopt_cegar", _parse);
+
+}
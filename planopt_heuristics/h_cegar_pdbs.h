@@ -0,0 +1,12 @@
+#ifndef PLANOPT_HEURISTICS_H_CEGAR_PDBS_H
+#define PLANOPT_HEURISTICS_H_CEGAR_PDBS_H
+
+#include "pdb_collection_heuristic.h"
+
+namespace planopt_heuristics {
+class CEGARPDBsHeuristic : public PDBCollectionHeuristic {
+public:
+    explicit CEGARPDBsHeuristic(const options::Options &options);
+};
+}
+#endif
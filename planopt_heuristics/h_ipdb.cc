@@ -1,5 +1,6 @@
 #include "h_ipdb.h"
 
+#include "pattern_collection_cache.h"
 #include "pattern_hillclimbing.h"
 
 #include "../globals.h"
@@ -9,31 +10,52 @@
 #include "../task_utils/sampling.h"
 #include "../task_utils/task_properties.h"
 #include "../utils/logging.h"
+#include "../utils/memory.h"
 #include "../utils/rng.h"
 
+#include <algorithm>
+
 using namespace std;
 
 namespace planopt_heuristics {
-CanonicalPatternDatabases create_cpdbs_by_hillclimbing(const TaskProxy &task_proxy, int size_bound) {
-    TNFTask task = create_tnf_task(task_proxy);
+static const int NUM_SAMPLES = 1000;
+static const int SAMPLING_SEED = 2017;
 
-    vector<Pattern> sampling_collection;
-    for (FactProxy goal : task_proxy.get_goals()) {
-        sampling_collection.push_back({goal.get_variable().get_id()});
-    }
-    CanonicalPatternDatabases sampling_heuristic(task, sampling_collection);
+static HillClimbingOptions get_hillclimbing_options(const options::Options &opts) {
+    HillClimbingOptions hillclimbing_options;
+    hillclimbing_options.max_time = opts.get<double>("max_time");
+    hillclimbing_options.max_iterations = opts.get<int>("max_iterations");
+    hillclimbing_options.min_improvement = opts.get<int>("min_improvement");
+    hillclimbing_options.max_memory_bytes = opts.get<double>("max_memory_bytes");
+    hillclimbing_options.racing = opts.get<bool>("racing");
+    hillclimbing_options.racing_initial_samples = opts.get<int>("racing_initial_samples");
+    hillclimbing_options.racing_error_probability =
+        opts.get<double>("racing_error_probability");
+    hillclimbing_options.pdb_options = get_pdb_options(opts);
+    hillclimbing_options.scoring = static_cast<CandidateScoring>(opts.get_enum("scoring"));
+    hillclimbing_options.min_expected_gain = opts.get<double>("min_expected_gain");
+    hillclimbing_options.abstract_search = opts.get<bool>("abstract_search");
+    hillclimbing_options.max_patterns_per_iteration =
+        opts.get<int>("max_patterns_per_iteration");
+    hillclimbing_options.max_improvement_overlap =
+        opts.get<double>("max_improvement_overlap");
+    return hillclimbing_options;
+}
 
+static SampleMatrix sample_states(
+    const TaskProxy &task_proxy, const TNFTask &tnf_task,
+    const CanonicalPatternDatabases &sampling_heuristic) {
     int init_h = sampling_heuristic.compute_heuristic(task_proxy.get_initial_state().get_values());
-    utils::RandomNumberGenerator rng(2017);
+    utils::RandomNumberGenerator rng(SAMPLING_SEED);
     int average_operator_cost = task_properties::get_average_operator_cost(task_proxy);
 
     g_log << "Sampling states for iPDB hillclimbing" << endl;
     vector<State> samples = sampling::sample_states_with_random_walks(
-        task_proxy, *g_successor_generator, 1000, init_h,
+        task_proxy, *g_successor_generator, NUM_SAMPLES, init_h,
         average_operator_cost,
         rng,
         [&](const State &state) {
-            return sampling_heuristic.compute_heuristic(state.get_values()) == numeric_limits<int>::max();
+            return sampling_heuristic.is_dead_end(state.get_values());
         });
     vector<TNFState> tnf_samples;
     tnf_samples.reserve(samples.size());
@@ -41,30 +63,310 @@ CanonicalPatternDatabases create_cpdbs_by_hillclimbing(const TaskProxy &task_pro
         tnf_samples.push_back(sample.get_values());
     }
     g_log << "Finished sampling states for iPDB hillclimbing" << endl;
+    return SampleMatrix(tnf_task.variable_domains, tnf_samples);
+}
 
-    vector<Pattern> collection = HillClimber(task, size_bound, move(tnf_samples)).run();
-    return CanonicalPatternDatabases(task, collection);
+/*
+  Use the same distribution of random walk lengths as the sampling: the
+  length is binomially distributed with mean twice the estimated number of
+  steps of a plan.
+*/
+static int compute_random_walk_length(
+    const TaskProxy &task_proxy, const CanonicalPatternDatabases &sampling_heuristic) {
+    int init_h = sampling_heuristic.compute_heuristic(task_proxy.get_initial_state().get_values());
+    if (init_h == 0 || init_h == numeric_limits<int>::max()) {
+        return 10;
+    }
+    int average_operator_cost = task_properties::get_average_operator_cost(task_proxy);
+    return max(1, static_cast<int>(4.0 * init_h / max(1, average_operator_cost)));
 }
 
-IPDBHeuristic::IPDBHeuristic(const options::Options &options)
-    : Heuristic(options),
-      cpdbs(create_cpdbs_by_hillclimbing(task_proxy, options.get<int>("size_bound"))) {
+/*
+  Everything that determines the selected collection apart from time
+  limits: the task, the size bound, the sampling and the hill-climbing
+  settings.
+*/
+static uint64_t compute_cache_fingerprint(
+    const TNFTask &task, int size_bound, const HillClimbingOptions &options) {
+    Fingerprint fingerprint;
+    add_task_to_fingerprint(task, fingerprint);
+    fingerprint.add(size_bound);
+    fingerprint.add(NUM_SAMPLES);
+    fingerprint.add(SAMPLING_SEED);
+    fingerprint.add(options.max_iterations);
+    fingerprint.add(options.min_improvement);
+    fingerprint.add_double(options.max_memory_bytes);
+    fingerprint.add(options.racing);
+    fingerprint.add(options.racing_initial_samples);
+    fingerprint.add_double(options.racing_error_probability);
+    fingerprint.add(static_cast<int>(options.scoring));
+    fingerprint.add_double(options.min_expected_gain);
+    fingerprint.add(options.max_patterns_per_iteration);
+    fingerprint.add_double(options.max_improvement_overlap);
+    return fingerprint.get();
 }
 
-int IPDBHeuristic::compute_heuristic(const GlobalState &global_state) {
-    TNFState state = global_state.get_values();
+/*
+  Select a collection by hill climbing, unless a cached collection is given,
+  and build its canonical PDBs. Newly selected collections are stored in the
+  cache if there is one, unless hill climbing hit the time limit, since the
+  collection then depends on the timing. Returns nullptr if hill climbing was
+  interrupted.
+*/
+static unique_ptr<CanonicalPatternDatabases> build_cpdbs(
+    const TNFTask &task, int size_bound, SampleMatrix &&samples,
+    const HillClimbingOptions &options, const vector<Pattern> *cached_collection,
+    const PatternCollectionCache *cache) {
+    HillClimber hill_climber(task, size_bound, move(samples), options);
+    vector<Pattern> collection;
+    if (cached_collection) {
+        collection = *cached_collection;
+    } else {
+        collection = hill_climber.run();
+        if (options.interrupted && *options.interrupted) {
+            return nullptr;
+        }
+        if (cache && !hill_climber.was_stopped_early()) {
+            cache->save(collection);
+        }
+    }
+    return utils::make_unique_ptr<CanonicalPatternDatabases>(
+        task, hill_climber.get_pdbs(collection));
+}
+
+IPDBHeuristic::IPDBHeuristic(const options::Options &options)
+    : PDBCollectionHeuristic(options),
+      size_bound(options.get<int>("size_bound")),
+      hillclimbing_options(get_hillclimbing_options(options)),
+      refinement_interval(options.get<int>("refinement_interval")),
+      num_refinement_samples(options.get<int>("refinement_samples")),
+      refinement_max_time(options.get<double>("refinement_max_time")),
+      num_evaluations(0),
+      rng(2017) {
+    if (options.get<bool>("symmetries")) {
+        if (hillclimbing_options.pdb_options.restrict_to_reachable) {
+            // Symmetries need not preserve the initial state.
+            g_log << "Symmetries are ignored for PDBs restricted to reachable states"
+                  << endl;
+        } else {
+            hillclimbing_options.symmetries = make_shared<TaskSymmetries>(
+                tnf_task, options.get<double>("max_symmetry_time"));
+        }
+    }
+    shared_ptr<PatternCollectionCache> cache;
+    string cache_directory = options.get<string>("pattern_cache");
+    if (!cache_directory.empty()) {
+        cache = make_shared<PatternCollectionCache>(
+            cache_directory,
+            compute_cache_fingerprint(tnf_task, size_bound, hillclimbing_options));
+    }
+    vector<Pattern> cached_collection;
+    bool use_cached_collection = cache && cache->load(tnf_task, cached_collection);
 
-    int h = cpdbs.compute_heuristic(state);
-    if (h == numeric_limits<int>::max()) {
-        return DEAD_END;
+    unique_ptr<CanonicalPatternDatabases> sampling_heuristic =
+        utils::make_unique_ptr<CanonicalPatternDatabases>(
+            tnf_task, get_goal_variable_singletons(task_proxy));
+    SampleMatrix samples(tnf_task.variable_domains, vector<TNFState>());
+    if (use_cached_collection) {
+        g_log << "Using " << cached_collection.size() << " cached patterns from "
+              << cache->get_path() << endl;
+    } else if (hillclimbing_options.scoring == CandidateScoring::ANALYTIC) {
+        hillclimbing_options.random_walk_length =
+            compute_random_walk_length(task_proxy, *sampling_heuristic);
     } else {
-        return h;
+        samples = sample_states(task_proxy, tnf_task, *sampling_heuristic);
+    }
+
+    if (options.get<bool>("background_construction")) {
+        /*
+          Search starts with the PDBs used for sampling while hill climbing
+          runs in the background.
+        */
+        set_cpdbs(move(sampling_heuristic));
+        const TNFTask &task = tnf_task;
+        int bound = size_bound;
+        HillClimbingOptions climbing_options = hillclimbing_options;
+        // Shared, so copies of the builder do not copy the samples.
+        shared_ptr<SampleMatrix> shared_samples = make_shared<SampleMatrix>(move(samples));
+        start_background_construction(
+            [&task, bound, climbing_options, shared_samples, use_cached_collection,
+             cached_collection, cache](const atomic<bool> &interrupted) {
+                HillClimbingOptions interruptible_options = climbing_options;
+                interruptible_options.interrupted = &interrupted;
+                return build_cpdbs(
+                    task, bound, move(*shared_samples), interruptible_options,
+                    use_cached_collection ? &cached_collection : nullptr, cache.get());
+            });
+    } else {
+        set_cpdbs(build_cpdbs(
+                      tnf_task, size_bound, move(samples), hillclimbing_options,
+                      use_cached_collection ? &cached_collection : nullptr, cache.get()));
+    }
+}
+
+void IPDBHeuristic::collect_evaluated_state(const GlobalState &state) {
+    if (static_cast<int>(evaluated_states.size()) < num_refinement_samples) {
+        evaluated_states.push_back(state.get_values());
+    } else {
+        int index = rng(num_evaluations);
+        if (index < num_refinement_samples) {
+            evaluated_states[index] = state.get_values();
+        }
+    }
+}
+
+void IPDBHeuristic::start_refinement() {
+    if (cpdbs.is_background_construction_running()) {
+        return;
+    }
+    /*
+      Hill climbing starts from the current collection and reuses its PDBs.
+      The size bound and the memory limit apply to the whole collection, so
+      PDBs are only added as long as they fit.
+    */
+    PDBCollection pdbs = cpdbs.get()->get_pdbs();
+    g_log << "Refining PDB collection with " << pdbs.size() << " PDBs on "
+          << evaluated_states.size() << " evaluated states" << endl;
+    const TNFTask &task = tnf_task;
+    int bound = size_bound;
+    HillClimbingOptions refinement_options = hillclimbing_options;
+    refinement_options.max_time = refinement_max_time;
+    // Refinement is driven by the evaluated states.
+    refinement_options.scoring = CandidateScoring::SAMPLES;
+    shared_ptr<SampleMatrix> samples =
+        make_shared<SampleMatrix>(task.variable_domains, evaluated_states);
+    start_background_construction(
+        [&task, bound, refinement_options, samples, pdbs](const atomic<bool> &interrupted) {
+            HillClimbingOptions interruptible_options = refinement_options;
+            interruptible_options.interrupted = &interrupted;
+            HillClimber hill_climber(task, bound, move(*samples), interruptible_options);
+            hill_climber.add_pdbs(pdbs);
+            vector<Pattern> initial_collection;
+            for (const shared_ptr<PatternDatabase> &pdb : pdbs) {
+                initial_collection.push_back(pdb->get_projection().get_pattern());
+            }
+            vector<Pattern> collection = hill_climber.run(initial_collection);
+            if (interrupted || collection.size() == initial_collection.size()) {
+                return unique_ptr<CanonicalPatternDatabases>();
+            }
+            return utils::make_unique_ptr<CanonicalPatternDatabases>(
+                task, hill_climber.get_pdbs(collection));
+        });
+}
+
+int IPDBHeuristic::compute_heuristic(const GlobalState &state) {
+    if (refinement_interval > 0) {
+        ++num_evaluations;
+        collect_evaluated_state(state);
+        if (num_evaluations % refinement_interval == 0) {
+            start_refinement();
+        }
     }
+    return PDBCollectionHeuristic::compute_heuristic(state);
 }
 
 static Heuristic *_parse(OptionParser &parser) {
-    Heuristic::add_options_to_parser(parser);
+    PDBCollectionHeuristic::add_options_to_parser(parser);
     parser.add_option<int>("size_bound");
+    parser.add_option<double>(
+        "max_time",
+        "maximum time in seconds for hill climbing",
+        "infinity",
+        Bounds("0.0", "infinity"));
+    parser.add_option<int>(
+        "max_iterations",
+        "maximum number of hill-climbing iterations",
+        "infinity",
+        Bounds("0", "infinity"));
+    parser.add_option<int>(
+        "min_improvement",
+        "minimum number of improved samples needed to accept a neighbor "
+        "(only with sample scoring)",
+        "1",
+        Bounds("1", "infinity"));
+    parser.add_option<double>(
+        "max_memory_bytes",
+        "maximum memory in bytes for the distance tables of the collection",
+        "infinity",
+        Bounds("0.0", "infinity"));
+    parser.add_option<bool>(
+        "racing",
+        "evaluate neighbors on growing sample prefixes and drop neighbors "
+        "that are unlikely to be the best one",
+        "false");
+    parser.add_option<int>(
+        "racing_initial_samples",
+        "number of samples in the first racing round",
+        "50",
+        Bounds("1", "infinity"));
+    parser.add_option<double>(
+        "racing_error_probability",
+        "probability of wrongly dropping a neighbor in a racing round",
+        "0.05",
+        Bounds("0.0", "1.0"));
+    parser.add_enum_option(
+        "scoring",
+        {"SAMPLES", "ANALYTIC"},
+        "score neighbors by the number of improved samples or by the gain in "
+        "expected goal distance under random walks in the projections "
+        "(needs no samples)",
+        "SAMPLES");
+    parser.add_option<double>(
+        "min_expected_gain",
+        "minimum gain in expected goal distance needed to accept a neighbor "
+        "(only with analytic scoring)",
+        "0.0",
+        Bounds("0.0", "infinity"));
+    parser.add_option<bool>(
+        "abstract_search",
+        "score neighbors on the samples with A* searches in their projections "
+        "instead of building their PDBs (only without racing)",
+        "false");
+    parser.add_option<int>(
+        "max_patterns_per_iteration",
+        "maximum number of improving neighbors accepted in one iteration "
+        "(only with sample scoring and without racing)",
+        "1",
+        Bounds("1", "infinity"));
+    parser.add_option<double>(
+        "max_improvement_overlap",
+        "maximum fraction of the improved samples of a further accepted "
+        "neighbor that may already be improved by the other accepted ones",
+        "0.1",
+        Bounds("0.0", "1.0"));
+    parser.add_option<int>(
+        "refinement_interval",
+        "refine the collection in the background on the states evaluated so "
+        "far every this many evaluations (0 disables refinement)",
+        "0",
+        Bounds("0", "infinity"));
+    parser.add_option<int>(
+        "refinement_samples",
+        "maximum number of evaluated states used for refinement",
+        "1000",
+        Bounds("1", "infinity"));
+    parser.add_option<double>(
+        "refinement_max_time",
+        "maximum time in seconds for each refinement",
+        "10.0",
+        Bounds("0.0", "infinity"));
+    parser.add_option<string>(
+        "pattern_cache",
+        "directory in which selected pattern collections are stored and "
+        "from which they are reused by later runs with the same task and "
+        "settings (empty disables the cache)",
+        "");
+    parser.add_option<bool>(
+        "symmetries",
+        "let PDBs of patterns that are symmetric under a structural symmetry "
+        "of the task share their distance tables",
+        "false");
+    parser.add_option<double>(
+        "max_symmetry_time",
+        "maximum time in seconds for computing the symmetries",
+        "10.0",
+        Bounds("0.0", "infinity"));
+    add_pdb_options_to_parser(parser);
     Options opts = parser.parse();
     if (parser.dry_run())
         return nullptr;
@@ -1,13 +1,33 @@
 #ifndef PLANOPT_HEURISTICS_H_IPDB_H
 #define PLANOPT_HEURISTICS_H_IPDB_H
 
-#include "canonical_pdbs.h"
+#include "pattern_hillclimbing.h"
+#include "pdb_collection_heuristic.h"
 
-#include "../heuristic.h"
+#include "../utils/rng.h"
+
+#include <vector>
 
 namespace planopt_heuristics {
-class IPDBHeuristic : public Heuristic {
-    CanonicalPatternDatabases cpdbs;
+class IPDBHeuristic : public PDBCollectionHeuristic {
+    int size_bound;
+    HillClimbingOptions hillclimbing_options;
+
+    /*
+      Online refinement: every refinement_interval evaluations (0 disables
+      it), hill climbing continues in the background from the current
+      collection, using a uniform sample of the states evaluated so far.
+    */
+    int refinement_interval;
+    int num_refinement_samples;
+    double refinement_max_time;
+    int num_evaluations;
+    std::vector<TNFState> evaluated_states;
+    utils::RandomNumberGenerator rng;
+
+    // Reservoir sampling over all evaluated states.
+    void collect_evaluated_state(const GlobalState &state);
+    void start_refinement();
 protected:
     virtual int compute_heuristic(const GlobalState &state) override;
 public:
@@ -6,9 +6,17 @@
 using namespace std;
 
 namespace planopt_heuristics {
+static Projection create_domain_abstraction(
+    const TNFTask &task, const Pattern &pattern, int max_domain_size) {
+    return Projection(task, pattern, compute_value_mappings(task, pattern, max_domain_size));
+}
+
 PDBHeuristic::PDBHeuristic(const options::Options &options)
     : Heuristic(options),
-      pdb(create_tnf_task(task_proxy), options.get_list<int>("pattern")) {
+      pdb(create_domain_abstraction(
+              create_tnf_task(task_proxy), options.get_list<int>("pattern"),
+              options.get<int>("max_domain_size")),
+          nullptr, get_pdb_options(options)) {
 }
 
 int PDBHeuristic::compute_heuristic(const GlobalState &global_state) {
@@ -25,6 +33,13 @@ int PDBHeuristic::compute_heuristic(const GlobalState &global_state) {
 static Heuristic *_parse(OptionParser &parser) {
     Heuristic::add_options_to_parser(parser);
     parser.add_list_option<int>("pattern");
+    parser.add_option<int>(
+        "max_domain_size",
+        "map the values of variables with larger domains to this many "
+        "abstract values (domain abstraction)",
+        "infinity",
+        Bounds("2", "infinity"));
+    add_pdb_options_to_parser(parser);
     Options opts = parser.parse();
     if (parser.dry_run())
         return nullptr;
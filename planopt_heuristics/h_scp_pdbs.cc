@@ -0,0 +1,43 @@
+#include "h_scp_pdbs.h"
+
+#include "../option_parser.h"
+#include "../plugin.h"
+
+using namespace std;
+
+namespace planopt_heuristics {
+SCPPDBsHeuristic::SCPPDBsHeuristic(const options::Options &options)
+    : Heuristic(options),
+      pdbs(create_tnf_task(task_proxy), options.get_list<vector<int>>("patterns"),
+           static_cast<PatternOrder>(options.get_enum("order"))) {
+}
+
+int SCPPDBsHeuristic::compute_heuristic(const GlobalState &global_state) {
+    TNFState state = global_state.get_values();
+
+    int h = pdbs.compute_heuristic(state);
+    if (h == numeric_limits<int>::max()) {
+        return DEAD_END;
+    } else {
+        return h;
+    }
+}
+
+static Heuristic *_parse(OptionParser &parser) {
+    Heuristic::add_options_to_parser(parser);
+    parser.add_list_option<vector<int>>("patterns");
+    parser.add_enum_option(
+        "order",
+        {"GIVEN", "GREEDY"},
+        "order in which the PDBs saturate the operator costs",
+        "GREEDY");
+    Options opts = parser.parse();
+    if (parser.dry_run())
+        return nullptr;
+    else
+        return new SCPPDBsHeuristic(opts);
+}
+
+static Plugin<Heuristic> _plugin("planopt_scp", _parse);
+
+}
@@ -0,0 +1,17 @@
+#ifndef PLANOPT_HEURISTICS_H_SCP_PDBS_H
+#define PLANOPT_HEURISTICS_H_SCP_PDBS_H
+
+#include "scp_pdbs.h"
+
+#include "../heuristic.h"
+
+namespace planopt_heuristics {
+class SCPPDBsHeuristic : public Heuristic {
+    SaturatedCostPartitioningPDBs pdbs;
+protected:
+    virtual int compute_heuristic(const GlobalState &state) override;
+public:
+    explicit SCPPDBsHeuristic(const options::Options &options);
+};
+}
+#endif
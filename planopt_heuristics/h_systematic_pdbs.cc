@@ -0,0 +1,71 @@
+#include "h_systematic_pdbs.h"
+
+#include "systematic_patterns.h"
+
+#include "../globals.h"
+#include "../option_parser.h"
+#include "../plugin.h"
+
+#include "../utils/logging.h"
+
+#include <thread>
+
+using namespace std;
+
+namespace planopt_heuristics {
+static CanonicalPatternDatabases create_cpdbs_systematically(
+    const TaskProxy &task_proxy, int max_pattern_size, int size_bound, int num_threads) {
+    TNFTask task = create_tnf_task(task_proxy);
+    vector<Pattern> patterns = generate_systematic_patterns(
+        task, max_pattern_size, size_bound);
+
+    if (num_threads == 0) {
+        num_threads = max(1u, thread::hardware_concurrency());
+    }
+    g_log << "Building systematic PDBs with " << num_threads << " threads" << endl;
+    PDBCollection pdbs = build_pattern_databases(task, patterns, num_threads);
+    g_log << "Finished building systematic PDBs" << endl;
+    return CanonicalPatternDatabases(task, move(pdbs));
+}
+
+SystematicPDBsHeuristic::SystematicPDBsHeuristic(const options::Options &options)
+    : Heuristic(options),
+      cpdbs(create_cpdbs_systematically(
+                task_proxy, options.get<int>("pattern_max_size"),
+                options.get<int>("size_bound"), options.get<int>("num_threads"))) {
+}
+
+int SystematicPDBsHeuristic::compute_heuristic(const GlobalState &global_state) {
+    TNFState state = global_state.get_values();
+
+    int h = cpdbs.compute_heuristic(state);
+    if (h == numeric_limits<int>::max()) {
+        return DEAD_END;
+    } else {
+        return h;
+    }
+}
+
+static Heuristic *_parse(OptionParser &parser) {
+    Heuristic::add_options_to_parser(parser);
+    parser.add_option<int>("size_bound");
+    parser.add_option<int>(
+        "pattern_max_size",
+        "maximal number of variables per pattern",
+        "2",
+        Bounds("1", "infinity"));
+    parser.add_option<int>(
+        "num_threads",
+        "number of threads used to build the PDBs (0 uses all cores)",
+        "0",
+        Bounds("0", "infinity"));
+    Options opts = parser.parse();
+    if (parser.dry_run())
+        return nullptr;
+    else
+        return new SystematicPDBsHeuristic(opts);
+}
+
+static Plugin<Heuristic> _plugin("planopt_systematic", _parse);
+
+}
@@ -0,0 +1,17 @@
+#ifndef PLANOPT_HEURISTICS_H_SYSTEMATIC_PDBS_H
+#define PLANOPT_HEURISTICS_H_SYSTEMATIC_PDBS_H
+
+#include "canonical_pdbs.h"
+
+#include "../heuristic.h"
+
+namespace planopt_heuristics {
+class SystematicPDBsHeuristic : public Heuristic {
+    CanonicalPatternDatabases cpdbs;
+protected:
+    virtual int compute_heuristic(const GlobalState &state) override;
+public:
+    explicit SystematicPDBsHeuristic(const options::Options &options);
+};
+}
+#endif
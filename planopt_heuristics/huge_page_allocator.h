@@ -0,0 +1,88 @@
+#ifndef PLANOPT_HEURISTICS_HUGE_PAGE_ALLOCATOR_H
+#define PLANOPT_HEURISTICS_HUGE_PAGE_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PLANOPT_HEURISTICS_HAS_POSIX_MEMALIGN
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace planopt_heuristics {
+/*
+  Allocator for large lookup tables. Allocations of at least one huge page are
+  aligned to the huge page size and, on Linux, marked as candidates for
+  transparent huge pages. This reduces TLB misses for random accesses into
+  the table. Smaller allocations, and all allocations on platforms without
+  posix_memalign, use the default allocator.
+*/
+template<typename T>
+class HugePageAllocator {
+    static bool is_huge(std::size_t num_bytes);
+public:
+    using value_type = T;
+
+    static const std::size_t huge_page_size = 2 * 1024 * 1024;
+
+    HugePageAllocator() = default;
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U> &) {
+    }
+
+    T *allocate(std::size_t n) {
+        std::size_t num_bytes = n * sizeof(T);
+        if (!is_huge(num_bytes)) {
+            return static_cast<T *>(::operator new(num_bytes));
+        }
+#ifdef PLANOPT_HEURISTICS_HAS_POSIX_MEMALIGN
+        num_bytes = (num_bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        void *memory = nullptr;
+        if (posix_memalign(&memory, huge_page_size, num_bytes) != 0) {
+            throw std::bad_alloc();
+        }
+#ifdef MADV_HUGEPAGE
+        // This is only a hint, so we ignore failures.
+        madvise(memory, num_bytes, MADV_HUGEPAGE);
+#endif
+        return static_cast<T *>(memory);
+#else
+        throw std::bad_alloc();
+#endif
+    }
+
+    void deallocate(T *memory, std::size_t n) {
+        if (!is_huge(n * sizeof(T))) {
+            ::operator delete(memory);
+        } else {
+            std::free(memory);
+        }
+    }
+};
+
+template<typename T>
+bool HugePageAllocator<T>::is_huge(std::size_t num_bytes) {
+#ifdef PLANOPT_HEURISTICS_HAS_POSIX_MEMALIGN
+    return num_bytes >= huge_page_size;
+#else
+    (void)num_bytes;
+    return false;
+#endif
+}
+
+template<typename T, typename U>
+bool operator==(const HugePageAllocator<T> &, const HugePageAllocator<U> &) {
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const HugePageAllocator<T> &, const HugePageAllocator<U> &) {
+    return false;
+}
+}
+
+#endif
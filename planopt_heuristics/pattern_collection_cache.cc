@@ -0,0 +1,146 @@
+#include "pattern_collection_cache.h"
+
+#include "external_memory.h"
+#include "thread_log.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace planopt_heuristics {
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+Fingerprint::Fingerprint()
+    : hash(FNV_OFFSET_BASIS) {
+}
+
+void Fingerprint::add(int64_t value) {
+    uint64_t bits = value;
+    for (int byte = 0; byte < 8; ++byte) {
+        hash ^= (bits >> (8 * byte)) & 0xff;
+        hash *= FNV_PRIME;
+    }
+}
+
+void Fingerprint::add_double(double value) {
+    int64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    add(bits);
+}
+
+void add_task_to_fingerprint(const TNFTask &task, Fingerprint &fingerprint) {
+    int num_variables = task.variable_domains.size();
+    fingerprint.add(num_variables);
+    for (int var = 0; var < num_variables; ++var) {
+        fingerprint.add(task.variable_domains[var]);
+        fingerprint.add(task.has_unknown_value[var]);
+        fingerprint.add(task.initial_state[var]);
+        fingerprint.add(task.goal_state[var]);
+    }
+    fingerprint.add(task.operators.size());
+    for (const TNFOperator &op : task.operators) {
+        fingerprint.add(op.cost);
+        fingerprint.add(op.entries.size());
+        for (const TNFOperatorEntry &entry : op.entries) {
+            fingerprint.add(entry.variable_id);
+            fingerprint.add(entry.precondition_value);
+            fingerprint.add(entry.effect_value);
+        }
+    }
+    fingerprint.add(task.mutex_groups.size());
+    for (const vector<FactPair> &group : task.mutex_groups) {
+        fingerprint.add(group.size());
+        for (const FactPair &fact : group) {
+            fingerprint.add(fact.var);
+            fingerprint.add(fact.value);
+        }
+    }
+}
+
+static string to_hex(uint64_t value) {
+    ostringstream out;
+    out << hex << value;
+    return out.str();
+}
+
+PatternCollectionCache::PatternCollectionCache(
+    const string &directory, uint64_t fingerprint)
+    : fingerprint(fingerprint),
+      path(directory + "/ipdb-" + to_hex(fingerprint) + ".patterns") {
+}
+
+/*
+  The file starts with the fingerprint and the number of patterns, followed
+  by one line per pattern with its size and its variables in increasing
+  order.
+*/
+bool PatternCollectionCache::load(const TNFTask &task, vector<Pattern> &collection) const {
+    ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    string stored_fingerprint;
+    int num_patterns;
+    if (!(in >> stored_fingerprint >> num_patterns) ||
+        stored_fingerprint != to_hex(fingerprint) || num_patterns < 0) {
+        thread_log << "Ignoring invalid pattern collection cache " << path << endl;
+        return false;
+    }
+    int num_variables = task.variable_domains.size();
+    vector<Pattern> patterns(num_patterns);
+    for (Pattern &pattern : patterns) {
+        int pattern_size;
+        if (!(in >> pattern_size) || pattern_size < 0 || pattern_size > num_variables) {
+            thread_log << "Ignoring invalid pattern collection cache " << path << endl;
+            return false;
+        }
+        pattern.resize(pattern_size);
+        int previous_var = -1;
+        for (int &var : pattern) {
+            if (!(in >> var) || var <= previous_var || var >= num_variables) {
+                thread_log << "Ignoring invalid pattern collection cache " << path << endl;
+                return false;
+            }
+            previous_var = var;
+        }
+    }
+    collection = move(patterns);
+    return true;
+}
+
+void PatternCollectionCache::save(const vector<Pattern> &collection) const {
+    /*
+      Write to a temporary file with a unique name first, so readers never
+      see partial files and concurrent writers do not interfere.
+    */
+    string temporary_path = create_temporary_file(path + ".tmp-");
+    if (temporary_path.empty()) {
+        thread_log << "Could not write pattern collection cache " << path << endl;
+        return;
+    }
+    {
+        ofstream out(temporary_path);
+        out << to_hex(fingerprint) << " " << collection.size() << endl;
+        for (const Pattern &pattern : collection) {
+            out << pattern.size();
+            for (int var : pattern) {
+                out << " " << var;
+            }
+            out << endl;
+        }
+        if (!out) {
+            thread_log << "Could not write pattern collection cache " << path << endl;
+            remove(temporary_path.c_str());
+            return;
+        }
+    }
+    if (rename(temporary_path.c_str(), path.c_str()) != 0) {
+        thread_log << "Could not write pattern collection cache " << path << endl;
+        remove(temporary_path.c_str());
+    }
+}
+}
@@ -0,0 +1,53 @@
+#ifndef PLANOPT_HEURISTICS_PATTERN_COLLECTION_CACHE_H
+#define PLANOPT_HEURISTICS_PATTERN_COLLECTION_CACHE_H
+
+#include "projection.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace planopt_heuristics {
+// 64-bit FNV-1a hash of a sequence of numbers.
+class Fingerprint {
+    uint64_t hash;
+public:
+    Fingerprint();
+
+    void add(int64_t value);
+    void add_double(double value);
+
+    uint64_t get() const {
+        return hash;
+    }
+};
+
+// Add variables, initial state, goal state, operators and mutex groups.
+extern void add_task_to_fingerprint(const TNFTask &task, Fingerprint &fingerprint);
+
+/*
+  Pattern collection stored in a file in the given directory whose name is
+  the fingerprint of everything that determines the collection, so later
+  runs with the same task and settings can skip the pattern selection.
+*/
+class PatternCollectionCache {
+    uint64_t fingerprint;
+    std::string path;
+public:
+    PatternCollectionCache(const std::string &directory, uint64_t fingerprint);
+
+    /*
+      Return false if there is no cached collection or the file cannot be
+      read or does not fit the task.
+    */
+    bool load(const TNFTask &task, std::vector<Pattern> &collection) const;
+    // Failures are only logged since the cache is optional.
+    void save(const std::vector<Pattern> &collection) const;
+
+    const std::string &get_path() const {
+        return path;
+    }
+};
+}
+
+#endif
@@ -1,10 +1,18 @@
 #include "pattern_hillclimbing.h"
 
+#include "abstract_search.h"
 #include "canonical_pdbs.h"
+#include "thread_log.h"
 
 #include "../globals.h"
 
-#include "../utils/logging.h"
+#include "../utils/countdown_timer.h"
+#include "../utils/memory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <unordered_set>
 
 using namespace std;
 
@@ -47,38 +55,40 @@ vector<set<int>> compute_causally_relevant_variables(const TNFTask &task)
   return relevant;
 }
 
-bool HillClimber::fits_size_bound(const std::vector<Pattern> &collection) const
+bool HillClimber::should_stop(const utils::CountdownTimer &timer) const
 {
-  /*
-      Compute the number of abstract states in the given collection without
-      explicitly computing the projections. Return true if the total size
-      is below size_bound and false otherwise.
-    */
-  // exercicio (f)
-  // calcular a soma dos estados abstratos: tem um total do conjunto, e um numero de estados pra cada pattern no conjunto
-  int total = 0;
-  for (const auto p : collection)
-  { // pra cada pattern na coleção
-    int val = 1;
-    for (const auto e : p)
-    {
-      // pra cada pattern dentro da coleção
-      val *= task.variable_domains[e]; // multiplica pelo dominio da variável no pattern
-    }
-    total += val;
-    // soma no total do conjunto
-    if (total > size_bound) // se passou do bound retorna falso
-      return false;
+  return timer.is_expired() || (options.interrupted && *options.interrupted);
+}
+
+double HillClimber::compute_num_abstract_states(const Pattern &pattern) const
+{
+  double num_states = 1;
+  for (int var_id : pattern)
+  {
+    num_states *= task.variable_domains[var_id];
   }
+  return num_states;
+}
 
-  return total <= size_bound;
+bool HillClimber::fits_size_bound(double num_abstract_states) const
+{
+  /*
+      A collection with the given total number of abstract states fits if it
+      is below size_bound and its distance tables (one int per abstract state)
+      do not exceed the memory limit.
+    */
+  return num_abstract_states <= size_bound &&
+         num_abstract_states * sizeof(int) <= options.max_memory_bytes;
 }
 
-HillClimber::HillClimber(const TNFTask &task, int size_bound, vector<TNFState> &&samples)
+HillClimber::HillClimber(const TNFTask &task, int size_bound, SampleMatrix &&samples,
+                         const HillClimbingOptions &options)
     : task(task),
       size_bound(size_bound),
       samples(move(samples)),
-      causally_relevant_variables(compute_causally_relevant_variables(task))
+      causally_relevant_variables(compute_causally_relevant_variables(task)),
+      options(options),
+      stopped_early(false)
 {
 }
 
@@ -104,7 +114,8 @@ vector<Pattern> HillClimber::compute_initial_collection()
   return collection;
 }
 
-vector<vector<Pattern>> HillClimber::compute_neighbors(const vector<Pattern> &collection)
+vector<Pattern> HillClimber::compute_neighbors(
+    const vector<Pattern> &collection, double collection_size)
 {
   /*
       for each pattern P in the collection C:
@@ -114,75 +125,570 @@ vector<vector<Pattern>> HillClimber::compute_neighbors(const vector<Pattern> &co
           for each variable V in the resulting set:
               add the collection C' := C u {P u {V}} to neighbors
 
+      Patterns are compared in their sorted form, so we can detect patterns
+      that already occur in C and duplicate neighbors with hash lookups.
     */
-  vector<vector<Pattern>> neighbors;
-  // exercício (f)
-  // pra cada P na coleção C:
-  for (const auto p : collection)
-  { // for each pattern P in collection C
+  unordered_set<Pattern, PatternHash> known_patterns;
+  for (const Pattern &pattern : collection)
+  {
+    Pattern sorted_pattern = pattern;
+    sort(sorted_pattern.begin(), sorted_pattern.end());
+    known_patterns.insert(move(sorted_pattern));
+  }
+
+  vector<Pattern> neighbors;
+  for (const Pattern &pattern : collection)
+  {
     set<int> causally_relevant;
-    for (const auto v : p)
-    { // set of variables that are causally relevant for any V in P
-      for (auto x : causally_relevant_variables[v])
+    for (int var_id : pattern)
+    {
+      for (int relevant_var_id : causally_relevant_variables[var_id])
       {
-        if (find(p.begin(), p.end(), x) == p.end()) // nao insere se já ta em p
-          causally_relevant.insert(x);
+        if (find(pattern.begin(), pattern.end(), relevant_var_id) == pattern.end())
+          causally_relevant.insert(relevant_var_id);
       }
     }
 
-    // pra cada variavel v no conjunto resultante
-    for (const auto v : causally_relevant)
-    {                                      // for each variable V in the resulting set:
-      vector<Pattern> clinha = collection; // add the collection C' := C
-      auto pl = p;
-      pl.push_back(v);
+    double pattern_size = compute_num_abstract_states(pattern);
+    for (int var_id : causally_relevant)
+    {
+      double new_pattern_size = pattern_size * task.variable_domains[var_id];
+      if (!fits_size_bound(collection_size + new_pattern_size))
+        continue;
 
-	
-	
-      // P' not in C
-      sort(pl.begin(),pl.end());
-      bool redundante = false;
-      for (const auto p_linha: collection){
-           auto p2 = p_linha;
-           sort(p2.begin(),p2.end());
-           if(p2 == pl){
-              redundante=true;
-              break;
-           }
-      }
+      Pattern new_pattern = pattern;
+      new_pattern.push_back(var_id);
+      sort(new_pattern.begin(), new_pattern.end());
+      // Skip patterns already in C and neighbors generated before.
+      if (known_patterns.insert(new_pattern).second)
+        neighbors.push_back(move(new_pattern));
+    }
+  }
+  return neighbors;
+}
 
-      if(redundante==false){
-          clinha.push_back(pl); // u {P u {V}}
-          if (fits_size_bound(clinha))
-            if(find(neighbors.begin(), neighbors.end(), clinha) == neighbors.end())
-            neighbors.push_back(clinha);
+vector<Pattern> HillClimber::select_additional_neighbors(
+    vector<ImprovingNeighbor> &improving_neighbors,
+    const Pattern &best_pattern, double collection_size) const
+{
+  stable_sort(improving_neighbors.begin(), improving_neighbors.end(),
+              [](const ImprovingNeighbor &lhs, const ImprovingNeighbor &rhs)
+              {
+                return lhs.improved_samples.size() > rhs.improved_samples.size();
+              });
 
-      }
-	
+  vector<bool> covered(samples.get_num_samples(), false);
+  for (const ImprovingNeighbor &neighbor : improving_neighbors)
+  {
+    if (neighbor.pattern == best_pattern)
+    {
+      for (int sample_id : neighbor.improved_samples)
+        covered[sample_id] = true;
+    }
+  }
+  double size = collection_size + compute_num_abstract_states(best_pattern);
+
+  vector<Pattern> additional_patterns;
+  for (const ImprovingNeighbor &neighbor : improving_neighbors)
+  {
+    if (static_cast<int>(additional_patterns.size()) + 1 >=
+        options.max_patterns_per_iteration)
+      break;
+    if (neighbor.pattern == best_pattern)
+      continue;
+    double new_size = size + compute_num_abstract_states(neighbor.pattern);
+    if (!fits_size_bound(new_size))
+      continue;
+    int num_overlapping = count_if(
+      neighbor.improved_samples.begin(), neighbor.improved_samples.end(),
+      [&](int sample_id) { return covered[sample_id]; });
+    if (num_overlapping > options.max_improvement_overlap * neighbor.improved_samples.size())
+      continue;
+    for (int sample_id : neighbor.improved_samples)
+      covered[sample_id] = true;
+    size = new_size;
+    additional_patterns.push_back(neighbor.pattern);
+  }
+  return additional_patterns;
+}
+
+shared_ptr<PatternDatabase> HillClimber::get_pdb(const Pattern &pattern)
+{
+  shared_ptr<PatternDatabase> &pdb = pdb_cache[pattern];
+  if (!pdb)
+    pdb = build_pdb(pattern);
+  return pdb;
+}
+
+shared_ptr<const PatternDatabase> HillClimber::get_representative_pdb(
+  const Pattern &representative)
+{
+  auto it = pdb_cache.find(representative);
+  if (it != pdb_cache.end())
+    return it->second;
+  weak_ptr<const PatternDatabase> &cached = representative_pdbs[representative];
+  shared_ptr<const PatternDatabase> pdb = cached.lock();
+  if (!pdb)
+  {
+    pdb = build_pdb(representative);
+    cached = pdb;
+  }
+  return pdb;
+}
 
-     // clinha.push_back(pl); // u {P u {V}}
-     // if (fits_size_bound(clinha))
-     //   neighbors.push_back(clinha);
+shared_ptr<PatternDatabase> HillClimber::build_pdb(const Pattern &pattern)
+{
+  if (options.symmetries)
+  {
+    TaskSymmetry symmetry;
+    Pattern representative = options.symmetries->compute_representative(pattern, symmetry);
+    if (representative != pattern)
+    {
+      shared_ptr<const PatternDatabase> image_pdb = get_representative_pdb(representative);
+      return make_shared<PatternDatabase>(
+        create_symmetric_projection(task, pattern, image_pdb->get_projection(), symmetry),
+        image_pdb);
     }
   }
-  return neighbors;
+
+  return make_shared<PatternDatabase>(Projection(task, pattern), options.pdb_options);
+}
+
+void HillClimber::prune_pdb_cache(const vector<Pattern> &collection)
+{
+  unordered_set<Pattern, PatternHash> patterns(collection.begin(), collection.end());
+  for (auto it = pdb_cache.begin(); it != pdb_cache.end();)
+  {
+    if (patterns.count(it->first))
+      ++it;
+    else
+      it = pdb_cache.erase(it);
+  }
+  for (auto it = representative_pdbs.begin(); it != representative_pdbs.end();)
+  {
+    if (it->second.expired())
+      it = representative_pdbs.erase(it);
+    else
+      ++it;
+  }
+}
+
+PDBCollection HillClimber::get_pdbs(const vector<Pattern> &collection)
+{
+  PDBCollection pdbs;
+  pdbs.reserve(collection.size() + 1);
+  for (const Pattern &pattern : collection)
+  {
+    pdbs.push_back(get_pdb(pattern));
+  }
+  return pdbs;
 }
 
 vector<int> HillClimber::compute_sample_heuristics(const vector<Pattern> &collection)
 {
-  CanonicalPatternDatabases cpdbs(task, collection);
-  vector<int> values;
-  values.reserve(samples.size());
-  for (const TNFState &sample : samples)
+  CanonicalPatternDatabases cpdbs(task, get_pdbs(collection));
+  return cpdbs.compute_heuristics(samples, 0, samples.get_num_samples());
+}
+
+vector<int> HillClimber::compute_sample_heuristics(
+    const vector<Pattern> &collection, const Pattern &added_pattern,
+    shared_ptr<PatternDatabase> &added_pdb)
+{
+  PDBCollection pdbs = get_pdbs(collection);
+  added_pdb = build_pdb(added_pattern);
+  pdbs.push_back(added_pdb);
+  CanonicalPatternDatabases cpdbs(task, move(pdbs));
+  return cpdbs.compute_heuristics(samples, 0, samples.get_num_samples());
+}
+
+vector<int> HillClimber::compute_sample_heuristics_by_search(
+    const vector<Pattern> &collection, const vector<int> &sample_values,
+    const Pattern &added_pattern)
+{
+  vector<Pattern> patterns(collection);
+  patterns.push_back(added_pattern);
+  int added_id = collection.size();
+  vector<int> additive_ids = build_compatibility_graph(patterns, task)[added_id];
+
+  PDBCollection additive_pdbs;
+  for (int id : additive_ids)
   {
-    values.push_back(cpdbs.compute_heuristic(sample));
+    if (id != added_id)
+      additive_pdbs.push_back(get_pdb(collection[id]));
+  }
+  int num_samples = samples.get_num_samples();
+  CanonicalPatternDatabases additive_cpdbs(task, move(additive_pdbs));
+  vector<int> additive_values = additive_cpdbs.compute_heuristics(samples, 0, num_samples);
+
+  // PDBs of sub-patterns of the added pattern guide the search.
+  vector<bool> in_added_pattern(task.variable_domains.size(), false);
+  for (int var_id : added_pattern)
+  {
+    in_added_pattern[var_id] = true;
+  }
+  PDBCollection heuristic_pdbs;
+  for (const Pattern &pattern : collection)
+  {
+    if (all_of(pattern.begin(), pattern.end(),
+               [&](int var_id) { return in_added_pattern[var_id]; }))
+      heuristic_pdbs.push_back(get_pdb(pattern));
+  }
+  AbstractDistanceCalculator calculator(task, added_pattern, move(heuristic_pdbs));
+
+  const int INF = numeric_limits<int>::max();
+  vector<int> values(sample_values);
+  for (int i = 0; i < num_samples; ++i)
+  {
+    if (values[i] == INF)
+      continue;
+    int distance = calculator.compute_distance(samples[i]);
+    if (distance == INF || additive_values[i] == INF)
+      values[i] = INF;
+    else
+      values[i] = max(values[i], distance + additive_values[i]);
   }
   return values;
 }
 
+vector<double> HillClimber::compute_expected_distances(
+    const PatternDatabase &walk_pdb, const PDBCollection &other_pdbs) const
+{
+  const Projection &projection = walk_pdb.get_projection();
+  const Pattern &pattern = projection.get_pattern();
+  const TNFTask &projected_task = projection.get_projected_task();
+  int num_states = projected_task.get_num_states();
+  int num_pdbs = other_pdbs.size() + 1;
+  int initial_state = projection.rank_state(projected_task.initial_state);
+  if (walk_pdb.lookup_index(initial_state) == numeric_limits<int>::max())
+  {
+    vector<double> expected_distances(num_pdbs, 0);
+    expected_distances[0] = numeric_limits<double>::infinity();
+    return expected_distances;
+  }
+
+  /*
+    Random walks use the operators of the planning task. In TNF, such an
+    operator has the precondition "unknown" for variables it does not
+    require, which matches every value here. Forget operators are skipped.
+  */
+  vector<int> pattern_positions(task.variable_domains.size(), -1);
+  for (size_t i = 0; i < pattern.size(); ++i)
+  {
+    pattern_positions[pattern[i]] = i;
+  }
+  vector<const TNFOperator *> walk_operators;
+  for (int op_id : projection.get_operator_ids())
+  {
+    const TNFOperator &op = task.operators[op_id];
+    bool forget = any_of(op.entries.begin(), op.entries.end(),
+                         [&](const TNFOperatorEntry &entry)
+                         {
+                           return task.is_unknown_value(entry.variable_id, entry.effect_value);
+                         });
+    if (!forget)
+      walk_operators.push_back(&op);
+  }
+
+  /*
+    Successors of abstract state s are successors[first_successor[s]...].
+    The goal distance of s in PDB i is distances[s * num_pdbs + i], where
+    PDB 0 is walk_pdb. The other PDBs look up s through a state of the task
+    that has the values of s on the pattern of walk_pdb.
+  */
+  vector<int> first_successor(num_states + 1, 0);
+  vector<int> successors;
+  vector<int> distances;
+  distances.reserve(static_cast<size_t>(num_states) * num_pdbs);
+  TNFState original_state(task.variable_domains.size(), 0);
+  for (int state = 0; state < num_states; ++state)
+  {
+    TNFState values = projection.unrank_state(state);
+    distances.push_back(walk_pdb.lookup_index(state));
+    for (size_t i = 0; i < pattern.size(); ++i)
+    {
+      original_state[pattern[i]] = values[i];
+    }
+    for (const shared_ptr<PatternDatabase> &pdb : other_pdbs)
+    {
+      distances.push_back(pdb->lookup_distance(original_state));
+    }
+    for (const TNFOperator *op : walk_operators)
+    {
+      TNFState successor(values);
+      bool applicable = true;
+      for (const TNFOperatorEntry &entry : op->entries)
+      {
+        int pos = pattern_positions[entry.variable_id];
+        if (pos == -1)
+          continue;
+        if (!task.is_unknown_value(entry.variable_id, entry.precondition_value) &&
+            values[pos] != projection.get_abstract_value(pos, entry.precondition_value))
+        {
+          applicable = false;
+          break;
+        }
+        successor[pos] = projection.get_abstract_value(pos, entry.effect_value);
+      }
+      if (applicable)
+        successors.push_back(projection.rank_state(successor));
+    }
+    first_successor[state + 1] = successors.size();
+  }
+
+  /*
+    Propagate the distribution over abstract states step by step and weight
+    the expected distances after each step by the probability of a walk of
+    that length. The other patterns are contained in that of walk_pdb, so
+    their distances are finite in all states that are no dead ends of
+    walk_pdb.
+  */
+  int n = options.random_walk_length;
+  vector<double> probabilities(num_states, 0);
+  vector<double> next_probabilities(num_states);
+  probabilities[initial_state] = 1;
+  vector<double> expected_distances(num_pdbs, 0);
+  vector<double> distance_sums(num_pdbs);
+  for (int length = 0; length <= n; ++length)
+  {
+    double length_probability =
+      exp(lgamma(n + 1) - lgamma(length + 1) - lgamma(n - length + 1) - n * log(2.0));
+    double alive = 0;
+    fill(distance_sums.begin(), distance_sums.end(), 0);
+    fill(next_probabilities.begin(), next_probabilities.end(), 0);
+    for (int state = 0; state < num_states; ++state)
+    {
+      double p = probabilities[state];
+      if (p == 0)
+        continue;
+      const int *state_distances = &distances[static_cast<size_t>(state) * num_pdbs];
+      if (state_distances[0] == numeric_limits<int>::max())
+      {
+        next_probabilities[initial_state] += p;
+        continue;
+      }
+      alive += p;
+      for (int i = 0; i < num_pdbs; ++i)
+      {
+        distance_sums[i] += p * state_distances[i];
+      }
+      int num_successors = first_successor[state + 1] - first_successor[state];
+      if (num_successors == 0)
+      {
+        next_probabilities[state] += p;
+        continue;
+      }
+      for (int i = first_successor[state]; i < first_successor[state + 1]; ++i)
+      {
+        next_probabilities[successors[i]] += p / num_successors;
+      }
+    }
+    if (alive > 0)
+    {
+      for (int i = 0; i < num_pdbs; ++i)
+      {
+        expected_distances[i] += length_probability * distance_sums[i] / alive;
+      }
+    }
+    swap(probabilities, next_probabilities);
+  }
+  return expected_distances;
+}
+
+bool HillClimber::select_neighbor_analytically(
+    const vector<Pattern> &collection, const vector<Pattern> &neighbors,
+    const utils::CountdownTimer &timer, Pattern &best_pattern,
+    shared_ptr<PatternDatabase> &best_pdb, double &best_gain)
+{
+  best_gain = 0;
+  for (const Pattern &neighbor : neighbors)
+  {
+    if (should_stop(timer))
+      return false;
+    shared_ptr<PatternDatabase> pdb = build_pdb(neighbor);
+
+    /*
+      Compare to the best pattern of the collection that is contained in the
+      neighbor. Sums over additive patterns are not considered, so the gain
+      overestimates the improvement of the canonical heuristic.
+    */
+    PDBCollection contained_pdbs;
+    for (const Pattern &pattern : collection)
+    {
+      if (includes(neighbor.begin(), neighbor.end(), pattern.begin(), pattern.end()))
+        contained_pdbs.push_back(get_pdb(pattern));
+    }
+    vector<double> expected_distances = compute_expected_distances(*pdb, contained_pdbs);
+    double base_distance = 0;
+    for (size_t i = 1; i < expected_distances.size(); ++i)
+    {
+      base_distance = max(base_distance, expected_distances[i]);
+    }
+    double gain = expected_distances[0] - base_distance;
+    if (gain > best_gain)
+    {
+      best_gain = gain;
+      best_pattern = neighbor;
+      best_pdb = move(pdb);
+    }
+  }
+  return true;
+}
+
+bool HillClimber::race_neighbors(
+    const vector<Pattern> &collection, const vector<Pattern> &neighbors,
+    const vector<int> &sample_values, const utils::CountdownTimer &timer,
+    Pattern &best_pattern, shared_ptr<PatternDatabase> &best_pdb,
+    int &best_improvement, vector<int> &best_sample_values)
+{
+  struct Candidate
+  {
+    const Pattern *pattern;
+    shared_ptr<PatternDatabase> pdb;
+    unique_ptr<CanonicalPatternDatabases> cpdbs;
+    vector<int> values;
+    int num_improved = 0;
+    bool eliminated = false;
+  };
+
+  vector<Candidate> candidates(neighbors.size());
+  for (size_t i = 0; i < neighbors.size(); ++i)
+  {
+    candidates[i].pattern = &neighbors[i];
+  }
+
+  /*
+    The distance tables of the candidates count against the memory limit
+    together with those of the collection. Candidates whose tables do not
+    fit release them after each round and rebuild them if they survive.
+  */
+  double collection_size = 0;
+  for (const Pattern &pattern : collection)
+  {
+    collection_size += compute_num_abstract_states(pattern);
+  }
+  double free_bytes = options.max_memory_bytes - collection_size * sizeof(int);
+  double candidate_bytes = 0;
+
+  int num_samples = samples.get_num_samples();
+  int num_evaluated = 0;
+  int prefix = min(max(options.racing_initial_samples, 1), num_samples);
+  bool out_of_time = false;
+  while (!candidates.empty())
+  {
+    /*
+      After n samples, the true fraction of improved samples of a candidate
+      lies within epsilon of its observed fraction with high probability.
+      Drop candidates whose optimistic estimate is below the pessimistic
+      estimate of the leader, and candidates that cannot reach the leader or
+      the minimal improvement even if all remaining samples improve. The
+      leader of the round so far is a valid reference, so candidates are
+      dropped (and their tables freed) right after their evaluation.
+    */
+    double epsilon = sqrt(log(2 / options.racing_error_probability) / (2.0 * prefix));
+    int num_remaining = num_samples - prefix;
+    int leader_improved = 0;
+    auto is_dominated = [&](const Candidate &candidate)
+    {
+      int max_reachable = candidate.num_improved + num_remaining;
+      return max_reachable < leader_improved ||
+             max_reachable < options.min_improvement ||
+             candidate.num_improved + 2 * epsilon * prefix < leader_improved;
+    };
+    auto release_tables = [&](Candidate &candidate)
+    {
+      if (candidate.cpdbs)
+        candidate_bytes -= compute_num_abstract_states(*candidate.pattern) * sizeof(int);
+      candidate.pdb = nullptr;
+      candidate.cpdbs = nullptr;
+    };
+
+    for (Candidate &candidate : candidates)
+    {
+      if (should_stop(timer))
+      {
+        out_of_time = true;
+        break;
+      }
+      if (!candidate.cpdbs)
+      {
+        PDBCollection pdbs = get_pdbs(collection);
+        candidate.pdb = build_pdb(*candidate.pattern);
+        pdbs.push_back(candidate.pdb);
+        candidate.cpdbs = utils::make_unique_ptr<CanonicalPatternDatabases>(task, move(pdbs));
+        candidate.values.reserve(num_samples);
+        candidate_bytes += compute_num_abstract_states(*candidate.pattern) * sizeof(int);
+      }
+      vector<int> prefix_values =
+        candidate.cpdbs->compute_heuristics(samples, num_evaluated, prefix);
+      for (int i = num_evaluated; i < prefix; ++i)
+      {
+        int h = prefix_values[i - num_evaluated];
+        candidate.values.push_back(h);
+        if (h > sample_values[i])
+          ++candidate.num_improved;
+      }
+      leader_improved = max(leader_improved, candidate.num_improved);
+      if (prefix < num_samples && is_dominated(candidate))
+      {
+        candidate.eliminated = true;
+        release_tables(candidate);
+      }
+      else if (candidate_bytes > free_bytes)
+      {
+        release_tables(candidate);
+      }
+    }
+    if (out_of_time || prefix == num_samples)
+      break;
+    num_evaluated = prefix;
+
+    candidates.erase(
+      remove_if(candidates.begin(), candidates.end(),
+                [&](const Candidate &candidate)
+                {
+                  return candidate.eliminated || is_dominated(candidate);
+                }),
+      candidates.end());
+    prefix = min(2 * prefix, num_samples);
+  }
+
+  /*
+    Only candidates that were evaluated on all samples can be compared to the
+    current collection.
+  */
+  best_improvement = 0;
+  for (Candidate &candidate : candidates)
+  {
+    if (static_cast<int>(candidate.values.size()) == num_samples &&
+        candidate.num_improved > best_improvement)
+    {
+      best_improvement = candidate.num_improved;
+      best_pattern = *candidate.pattern;
+      best_pdb = candidate.pdb;
+      best_sample_values = move(candidate.values);
+    }
+  }
+  return !out_of_time;
+}
+
+void HillClimber::add_pdbs(const PDBCollection &pdbs)
+{
+  for (const shared_ptr<PatternDatabase> &pdb : pdbs)
+  {
+    pdb_cache[pdb->get_projection().get_pattern()] = pdb;
+  }
+}
+
 vector<Pattern> HillClimber::run()
 {
-  vector<Pattern> current_collection = compute_initial_collection();
+  return run(compute_initial_collection());
+}
+
+vector<Pattern> HillClimber::run(const vector<Pattern> &initial_collection)
+{
+  stopped_early = false;
+  vector<Pattern> current_collection = initial_collection;
+  prune_pdb_cache(current_collection);
   vector<int> current_sample_values = compute_sample_heuristics(current_collection);
 
   /*
@@ -203,38 +709,165 @@ vector<Pattern> HillClimber::run()
   int num_maiores;
   // exercício (f)
   vector<Pattern> current = current_collection;
-  vector<Pattern> next_current;
+  double current_size = 0;
+  for (const Pattern &pattern : current)
+  {
+    current_size += compute_num_abstract_states(pattern);
+  }
+  Pattern next_pattern;
+  shared_ptr<PatternDatabase> next_pdb;
   vector<int> next_current_sample_values;
+  utils::CountdownTimer timer(options.max_time);
+  int num_iterations = 0;
   while (true)
   {
-    vector<vector<Pattern>> neighbours = compute_neighbors(current);
+    if (num_iterations >= options.max_iterations)
+    {
+      thread_log << "Hill climbing reached the iteration limit" << endl;
+      return current;
+    }
+    ++num_iterations;
+
+    vector<Pattern> neighbours = compute_neighbors(current, current_size);
     improvement = 0;
+    vector<ImprovingNeighbor> improving_neighbors;
+
+    bool out_of_time = false;
+    if (options.scoring == CandidateScoring::ANALYTIC)
+    {
+      /*
+        There are no samples to count, so min_expected_gain takes the place
+        of min_improvement.
+      */
+      double gain;
+      out_of_time = !select_neighbor_analytically(
+        current, neighbours, timer, next_pattern, next_pdb, gain);
+      if (gain > 0 && gain >= options.min_expected_gain)
+        improvement = 1;
+    }
+    else if (options.racing)
+    {
+      out_of_time = !race_neighbors(
+        current, neighbours, current_sample_values, timer,
+        next_pattern, next_pdb, improvement, next_current_sample_values);
+    }
+    else
+    {
+      for (const Pattern &n : neighbours)
+      {
+        if (should_stop(timer))
+        {
+          out_of_time = true;
+          break;
+        }
+
+        // acha o vizinho com máximo
+        shared_ptr<PatternDatabase> n_pdb;
+        vector<int> n_sample_values;
+        if (options.abstract_search)
+          n_sample_values = compute_sample_heuristics_by_search(
+            current, current_sample_values, n);
+        else
+          n_sample_values = compute_sample_heuristics(current, n, n_pdb);
+
+        num_maiores = 0;
+        for (unsigned int i = 0; i < n_sample_values.size(); i++)
+        {
+          if (n_sample_values[i] > current_sample_values[i])
+            num_maiores += 1;
+        }
+        if (options.max_patterns_per_iteration > 1 &&
+            num_maiores >= max(1, options.min_improvement))
+        {
+          ImprovingNeighbor neighbor;
+          neighbor.pattern = n;
+          neighbor.pdb = n_pdb;
+          for (unsigned int i = 0; i < n_sample_values.size(); i++)
+          {
+            if (n_sample_values[i] > current_sample_values[i])
+              neighbor.improved_samples.push_back(i);
+          }
+          improving_neighbors.push_back(move(neighbor));
+        }
+        if (num_maiores > improvement)
+        {
+          improvement = num_maiores;
+          next_pattern = n;
+          next_pdb = move(n_pdb);
+          next_current_sample_values = move(n_sample_values);
+        }
+      }
+    }
 
-    for (const auto n : neighbours)
+    int min_improvement = options.scoring == CandidateScoring::ANALYTIC ?
+      1 : options.min_improvement;
+    if (improvement == 0 || improvement < min_improvement)
     {
-      // acha o vizinho com máximo
-      vector<int> n_sample_values = compute_sample_heuristics(n);
+      if (out_of_time)
+      {
+        thread_log << "Hill climbing ran out of time or was interrupted" << endl;
+        stopped_early = true;
+      }
+      return current;
+    }
+    vector<Pattern> additional_patterns;
+    if (improving_neighbors.size() > 1 && !out_of_time)
+      additional_patterns = select_additional_neighbors(
+        improving_neighbors, next_pattern, current_size);
+    current.push_back(next_pattern);
+    if (!next_pdb)
+      next_pdb = build_pdb(next_pattern);
+    pdb_cache[next_pattern] = move(next_pdb);
+    current_size += compute_num_abstract_states(next_pattern);
 
-      num_maiores = 0;
-      for (unsigned int i = 0; i < n_sample_values.size(); i++)
+    if (!additional_patterns.empty())
+    {
+      /*
+        The improvements of the neighbors need not add up, so the combined
+        collection is evaluated once and only kept if it improves more
+        samples than the best neighbor alone. The PDBs built for scoring the
+        neighbors are cached first, so this builds no further PDBs.
+      */
+      for (const ImprovingNeighbor &neighbor : improving_neighbors)
+      {
+        if (neighbor.pdb &&
+            find(additional_patterns.begin(), additional_patterns.end(),
+                 neighbor.pattern) != additional_patterns.end())
+          pdb_cache[neighbor.pattern] = neighbor.pdb;
+      }
+      vector<Pattern> combined(current);
+      combined.insert(combined.end(), additional_patterns.begin(), additional_patterns.end());
+      vector<int> combined_sample_values = compute_sample_heuristics(combined);
+      int combined_improvement = 0;
+      for (size_t i = 0; i < combined_sample_values.size(); ++i)
       {
-        if (n_sample_values[i] > current_sample_values[i])
-          num_maiores += 1;
+        if (combined_sample_values[i] > current_sample_values[i])
+          ++combined_improvement;
       }
-      if (num_maiores > improvement)
+      if (combined_improvement > improvement)
       {
-        improvement = num_maiores;
-        next_current = n;
-        next_current_sample_values = n_sample_values;
+        current = move(combined);
+        for (const Pattern &pattern : additional_patterns)
+          current_size += compute_num_abstract_states(pattern);
+        next_current_sample_values = move(combined_sample_values);
+      }
+      else
+      {
+        prune_pdb_cache(current);
       }
     }
+    current_sample_values = move(next_current_sample_values);
 
-    if (improvement == 0)
+    /*
+      The best neighbor evaluated before the timeout is still an improvement,
+      so we keep it and stop afterwards.
+    */
+    if (out_of_time)
     {
+      thread_log << "Hill climbing ran out of time or was interrupted" << endl;
+      stopped_early = true;
       return current;
     }
-    current = next_current;
-    current_sample_values = next_current_sample_values;
   }
 }
 } // namespace planopt_heuristics
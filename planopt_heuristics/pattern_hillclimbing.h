@@ -1,26 +1,228 @@
 #ifndef PLANOPT_HEURISTICS_PATTERN_HILLCLIMBING_H
 #define PLANOPT_HEURISTICS_PATTERN_HILLCLIMBING_H
 
-#include "projection.h"
+#include "pdb.h"
+#include "sample_matrix.h"
+#include "task_symmetries.h"
 
+#include <atomic>
+#include <limits>
+#include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
+namespace utils {
+class CountdownTimer;
+}
+
 namespace planopt_heuristics {
+enum class CandidateScoring {
+    // Count the samples whose heuristic value improves.
+    SAMPLES,
+    /*
+      Compare the expected goal distance of a new pattern with that of the
+      pattern it extends, under the distribution of abstract states reached
+      by random walks in the projection. Needs no samples.
+    */
+    ANALYTIC
+};
+
+/*
+  Limits that make the hill climbing anytime: as soon as one of them is hit,
+  run() stops and returns the best collection found so far.
+*/
+struct HillClimbingOptions {
+    double max_time = std::numeric_limits<double>::infinity();
+    int max_iterations = std::numeric_limits<int>::max();
+    // Minimal number of improved samples required to accept a neighbor.
+    // Only used with sample scoring.
+    int min_improvement = 1;
+    // Bound on the memory of all distance tables of a collection in bytes.
+    double max_memory_bytes = std::numeric_limits<double>::infinity();
+
+    /*
+      Racing evaluates the neighbors on growing prefixes of the samples and
+      drops neighbors whose number of improved samples is unlikely to reach
+      that of the current leader (Hoeffding bound with error probability
+      racing_error_probability).
+    */
+    bool racing = false;
+    int racing_initial_samples = 50;
+    double racing_error_probability = 0.05;
+
+    // Options for all PDBs built during hill climbing.
+    PDBOptions pdb_options;
+
+    CandidateScoring scoring = CandidateScoring::SAMPLES;
+    /*
+      For analytic scoring, the random walk length is binomially distributed
+      with random_walk_length trials and success probability 1/2.
+    */
+    int random_walk_length = 10;
+    // Minimal gain in expected distance required to accept a neighbor.
+    double min_expected_gain = 0;
+
+    /*
+      With sample scoring and without racing, the goal distances of the
+      samples in the projection to a neighbor pattern are computed by A* in
+      the projection instead of building its PDB. Only the PDB of the
+      accepted neighbor is built.
+    */
+    bool abstract_search = false;
+
+    /*
+      With sample scoring and without racing, up to this many improving
+      neighbors are accepted in one iteration. Further neighbors are added
+      greedily by their number of improved samples if at most a fraction of
+      max_improvement_overlap of their improved samples is already improved
+      by the neighbors chosen before and the collection still fits the size
+      bound. The combined collection is kept only if it improves more
+      samples than the best neighbor alone.
+    */
+    int max_patterns_per_iteration = 1;
+    double max_improvement_overlap = 0.1;
+
+    /*
+      If set, the PDB of a pattern whose orbit representative differs from
+      it shares the tables of the representative's PDB. The symmetries must
+      not be used with PDBs restricted to reachable states.
+    */
+    std::shared_ptr<const TaskSymmetries> symmetries;
+
+    // If set, hill climbing stops as soon as the flag becomes true.
+    const std::atomic<bool> *interrupted = nullptr;
+};
+
+/*
+  Variables v and w are causally relevant for each other if they occur in the
+  same operator and one of them is changed by it.
+*/
+extern std::vector<std::set<int>> compute_causally_relevant_variables(const TNFTask &task);
+
 class HillClimber {
     const TNFTask &task;
     int size_bound;
-    std::vector<TNFState> samples;
+    SampleMatrix samples;
     const std::vector<std::set<int>> causally_relevant_variables;
+    HillClimbingOptions options;
 
-    bool fits_size_bound(const std::vector<Pattern> &collection) const;
+    /*
+      PDBs of the patterns in the current collection. They are built once and
+      reused for all neighbors in all iterations.
+    */
+    std::unordered_map<Pattern, std::shared_ptr<PatternDatabase>, PatternHash> pdb_cache;
+    // PDBs of orbit representatives that are shared by symmetric patterns.
+    std::unordered_map<Pattern, std::weak_ptr<const PatternDatabase>, PatternHash>
+    representative_pdbs;
+    bool stopped_early;
+
+    // True if the time limit is reached or hill climbing was interrupted.
+    bool should_stop(const utils::CountdownTimer &timer) const;
+    double compute_num_abstract_states(const Pattern &pattern) const;
+    bool fits_size_bound(double num_abstract_states) const;
     std::vector<Pattern> compute_initial_collection();
-    std::vector<std::vector<Pattern>> compute_neighbors(
-        const std::vector<Pattern> &collection);
+    /*
+      A neighbor of the collection C is C u {P'}. We only represent it by
+      the sorted pattern P' that is added to C.
+    */
+    std::vector<Pattern> compute_neighbors(
+        const std::vector<Pattern> &collection, double collection_size);
+    /*
+      A neighbor, the ids of the samples whose heuristic value it improves and
+      the PDB built for scoring it (nullptr with abstract search).
+    */
+    struct ImprovingNeighbor {
+        Pattern pattern;
+        std::vector<int> improved_samples;
+        std::shared_ptr<PatternDatabase> pdb;
+    };
+    /*
+      Choose the neighbors accepted together with best_pattern according to
+      max_patterns_per_iteration and max_improvement_overlap.
+    */
+    std::vector<Pattern> select_additional_neighbors(
+        std::vector<ImprovingNeighbor> &improving_neighbors,
+        const Pattern &best_pattern, double collection_size) const;
+    // Return the cached PDB of a pattern of the current collection.
+    std::shared_ptr<PatternDatabase> get_pdb(const Pattern &pattern);
+    /*
+      Build the PDB of a new pattern, reusing the tables of the PDB of a
+      symmetric pattern if possible.
+    */
+    std::shared_ptr<PatternDatabase> build_pdb(const Pattern &pattern);
+    std::shared_ptr<const PatternDatabase> get_representative_pdb(const Pattern &representative);
+    // Keep only the PDBs of the given collection in the cache.
+    void prune_pdb_cache(const std::vector<Pattern> &collection);
     std::vector<int> compute_sample_heuristics(const std::vector<Pattern> &collection);
+    /*
+      The PDB of added_pattern is built with build_pdb() and returned in
+      added_pdb, so it can be cached if the neighbor is accepted.
+    */
+    std::vector<int> compute_sample_heuristics(
+        const std::vector<Pattern> &collection, const Pattern &added_pattern,
+        std::shared_ptr<PatternDatabase> &added_pdb);
+    /*
+      Same values without the PDB of added_pattern: the canonical heuristic
+      of C u {P} is the maximum of h^C and the sum of h^P and the canonical
+      heuristic of the patterns of C that are additive with P. The values of
+      h^P come from A* searches in the projection to P.
+    */
+    std::vector<int> compute_sample_heuristics_by_search(
+        const std::vector<Pattern> &collection, const std::vector<int> &sample_values,
+        const Pattern &added_pattern);
+    /*
+      Expected goal distances in walk_pdb and in each of the other PDBs at the
+      end of a random walk in the projection of walk_pdb from the projected
+      initial state. Walks do not use forget operators and restart from the
+      initial state when they hit a dead end of walk_pdb. The patterns of the
+      other PDBs must be subsets of the pattern of walk_pdb, which must not
+      use a domain abstraction. If the initial state is a dead end of
+      walk_pdb, its entry is infinite and the others are 0.
+    */
+    std::vector<double> compute_expected_distances(
+        const PatternDatabase &walk_pdb, const PDBCollection &other_pdbs) const;
+    /*
+      Select the neighbor whose expected distance improves most over the
+      best pattern of the collection it contains, both under the random
+      walks in the projection to the neighbor. Returns false if the time ran
+      out.
+    */
+    bool select_neighbor_analytically(
+        const std::vector<Pattern> &collection, const std::vector<Pattern> &neighbors,
+        const utils::CountdownTimer &timer, Pattern &best_pattern,
+        std::shared_ptr<PatternDatabase> &best_pdb, double &best_gain);
+    /*
+      Select the best neighbor by racing. Returns false if the time ran out
+      before the race was decided; the best neighbor so far is returned then.
+    */
+    bool race_neighbors(
+        const std::vector<Pattern> &collection, const std::vector<Pattern> &neighbors,
+        const std::vector<int> &sample_values, const utils::CountdownTimer &timer,
+        Pattern &best_pattern, std::shared_ptr<PatternDatabase> &best_pdb,
+        int &best_improvement, std::vector<int> &best_sample_values);
 public:
-    HillClimber(const TNFTask &task, int size_bound, std::vector<TNFState> &&samples);
+    // The samples are moved in, so callers need not keep an unpacked copy.
+    HillClimber(const TNFTask &task, int size_bound, SampleMatrix &&samples,
+                const HillClimbingOptions &options = HillClimbingOptions());
     std::vector<Pattern> run();
+    /*
+      Start hill climbing from the given collection instead of the goal
+      variable singletons. The collection is part of the result.
+    */
+    std::vector<Pattern> run(const std::vector<Pattern> &initial_collection);
+    /*
+      True if the last call of run() stopped because of the time limit or an
+      interruption, so its result depends on the timing.
+    */
+    bool was_stopped_early() const {
+        return stopped_early;
+    }
+
+    // Reuse already built PDBs for their patterns.
+    void add_pdbs(const PDBCollection &pdbs);
+    // PDBs of a collection returned by run(), built only if necessary.
+    PDBCollection get_pdbs(const std::vector<Pattern> &collection);
 };
 }
 
@@ -1,9 +1,21 @@
 #include "pdb.h"
 
-#include "../utils/logging.h"
+#include "thread_log.h"
 
+#include "../option_parser.h"
+
+#include "../utils/memory.h"
+#include "../utils/system.h"
+#include "../utils/timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
 #include <queue>
 #include <set>
+#include <thread>
+
 using namespace std;
 
 namespace planopt_heuristics
@@ -15,8 +27,157 @@ namespace planopt_heuristics
 */
 using QueueEntry = pair<int, int>;
 
+/*
+  Use a sparse table if at most this fraction of the abstract states is
+  reachable. A sparse table needs about 1.5 bits per abstract state for the
+  index plus one int per reachable state.
+*/
+static const double MAX_SPARSE_REACHABLE_FRACTION = 0.5;
+
+/*
+  Maximal number of open list buckets that are open for writing at the same
+  time during external construction. Each has a buffer of 1/16 of the buffer
+  size.
+*/
+static const int MAX_OPEN_BUCKET_WRITERS = 16;
+
+static bool test_bit(const vector<uint64_t> &bits, int index)
+{
+  return (bits[index >> 6] >> (index & 63)) & 1;
+}
+
+static void set_bit(vector<uint64_t> &bits, int index)
+{
+  bits[index >> 6] |= uint64_t(1) << (index & 63);
+}
+
 PatternDatabase::PatternDatabase(const TNFTask &task, const Pattern &pattern)
+    : PatternDatabase(Projection(task, pattern))
+{
+}
+
+PatternDatabase::PatternDatabase(
+    Projection &&abstraction, const PDBOptions &options)
+    : projection(move(abstraction))
+{
+  vector<int> projected_operator_costs;
+  for (const TNFOperator &op : projection.get_projected_task().operators)
+  {
+    projected_operator_costs.push_back(op.cost);
+  }
+  vector<uint64_t> reachable;
+  if (options.restrict_to_reachable)
+    reachable = compute_reachable_states();
+  compute_distances(projected_operator_costs, reachable, options);
+}
+
+PatternDatabase::PatternDatabase(
+    const TNFTask &task, const Pattern &pattern, const vector<int> &operator_costs)
     : projection(task, pattern)
+{
+  vector<int> projected_operator_costs;
+  for (int op_id : projection.get_operator_ids())
+  {
+    projected_operator_costs.push_back(operator_costs[op_id]);
+  }
+  compute_distances(projected_operator_costs);
+}
+
+PatternDatabase::PatternDatabase(
+    Projection &&symmetric_projection, const shared_ptr<const PatternDatabase> &image)
+    : projection(move(symmetric_projection)),
+      distance_table(nullptr),
+      dead_state_fraction(image->dead_state_fraction),
+      unit_cost(image->unit_cost),
+      image_pdb(image->image_pdb ? image->image_pdb : image)
+{
+}
+
+vector<uint64_t> PatternDatabase::compute_reachable_states() const
+{
+  /*
+    Forward search from the projected initial state. Like in the regression,
+    successors violating a mutex of the task are not generated.
+  */
+  const TNFTask &projected_task = projection.get_projected_task();
+  int num_states = projected_task.get_num_states();
+  vector<uint64_t> reachable((num_states + 63) / 64, 0);
+  int initial_state = projection.rank_state(projected_task.initial_state);
+  set_bit(reachable, initial_state);
+  vector<int> open = {initial_state};
+  while (!open.empty())
+  {
+    TNFState state = projection.unrank_state(open.back());
+    open.pop_back();
+    for (const TNFOperator &op : projected_task.operators)
+    {
+      bool applicable = true;
+      for (const TNFOperatorEntry &entry : op.entries)
+      {
+        if (state[entry.variable_id] != entry.precondition_value)
+        {
+          applicable = false;
+          break;
+        }
+      }
+      if (!applicable)
+        continue;
+      TNFState successor(state);
+      bool spurious = false;
+      for (const TNFOperatorEntry &entry : op.entries)
+      {
+        successor[entry.variable_id] = entry.effect_value;
+      }
+      for (const TNFOperatorEntry &entry : op.entries)
+      {
+        if (projection.violates_mutex(successor, entry.variable_id, entry.effect_value))
+        {
+          spurious = true;
+          break;
+        }
+      }
+      if (spurious)
+        continue;
+      int successor_index = projection.rank_state(successor);
+      if (!test_bit(reachable, successor_index))
+      {
+        set_bit(reachable, successor_index);
+        open.push_back(successor_index);
+      }
+    }
+  }
+  return reachable;
+}
+
+struct PatternDatabase::PredecessorFilter
+{
+  // Bitmap of the states that may be generated, all states if empty.
+  const vector<uint64_t> *reachable = nullptr;
+  // Operators that are regressed, all operators if empty.
+  const vector<bool> *operators = nullptr;
+};
+
+/*
+  Return the cost of all operators with positive cost if it is the same for
+  all of them and -1 otherwise.
+*/
+static int get_unit_cost(const vector<int> &operator_costs)
+{
+  int unit_cost = 0;
+  for (int cost : operator_costs)
+  {
+    if (cost == 0)
+      continue;
+    if (unit_cost != 0 && cost != unit_cost)
+      return -1;
+    unit_cost = cost;
+  }
+  return max(unit_cost, 1);
+}
+
+void PatternDatabase::compute_distances(const vector<int> &projected_operator_costs,
+                                        const vector<uint64_t> &reachable,
+                                        const PDBOptions &options)
 {
   /*
       We want to compute goal distances for all abstract states in the
@@ -29,64 +190,569 @@ PatternDatabase::PatternDatabase(const TNFTask &task, const Pattern &pattern)
       index use rank(s) and to go from an index i to its state use unrank(i).
     */
   const TNFTask &projected_task = projection.get_projected_task();
-  distances.resize(projected_task.get_num_states(), numeric_limits<int>::max());
+  int num_states = projected_task.get_num_states();
+  unit_cost = get_unit_cost(projected_operator_costs);
+  bool external = !options.external_memory_directory.empty();
+  bool store_distances_mod_3 = options.store_distances_mod_3 && !external &&
+                               unit_cost != -1;
+  if (options.store_distances_mod_3 && !store_distances_mod_3)
+  {
+    thread_log << "Distances modulo 3 need in-memory construction and a single "
+               << "positive operator cost, storing full distances" << endl;
+  }
+
+  reachable_states.clear();
+  reachable_state_ranks.clear();
+  distance_mod_3.clear();
+  byte_layers.clear();
+  short_layers.clear();
+  distances.clear();
+  external_distances.reset();
+  if (store_distances_mod_3)
+  {
+    distance_mod_3.assign((num_states + 31) / 32, ~uint64_t(0));
+  }
+  else if (external)
+  {
+    // The table is set up by compute_distances_externally().
+  }
+  else if (reachable.empty())
+  {
+    distances.assign(num_states, numeric_limits<int>::max());
+  }
+  else
+  {
+    int num_reachable = 0;
+    vector<int> ranks;
+    ranks.reserve(reachable.size());
+    for (uint64_t word : reachable)
+    {
+      ranks.push_back(num_reachable);
+      num_reachable += count_set_bits(word);
+    }
+    if (num_reachable <= MAX_SPARSE_REACHABLE_FRACTION * num_states)
+    {
+      reachable_states = reachable;
+      reachable_state_ranks = move(ranks);
+      distances.assign(num_reachable, numeric_limits<int>::max());
+    }
+    else
+    {
+      distances.assign(num_states, numeric_limits<int>::max());
+    }
+  }
+  distance_table = distances.data();
+
+  PredecessorFilter filter;
+  if (!reachable.empty())
+    filter.reachable = &reachable;
 
-  /*
-      Priority queues usually order entries so the largest entry is the first.
-      By using the comparator greater<T> instead of the default less<T>, we
-      change the ordering to sort the smallest element first.
-    */
-  priority_queue<QueueEntry, vector<QueueEntry>, greater<QueueEntry>> queue;
-  
   /*
       Note that we start with the goal state to turn the search into a regression.
       We also have to switch the role of precondition and effect in operators
       later on. This is sufficient to turn the search into a regression since
       the task is in TNF.
     */
-  queue.push({0, projection.rank_state(projected_task.goal_state)});
+  int goal_state = projection.rank_state(projected_task.goal_state);
+  bool goal_reachable = reachable.empty() || test_bit(reachable, goal_state);
+  if (external)
+  {
+    compute_distances_externally(goal_reachable ? goal_state : -1,
+                                 projected_operator_costs, filter, options);
+  }
+  else if (store_distances_mod_3)
+  {
+    /*
+      The first regression only finds the number of layers. The second one
+      stores the layers in a table that is just wide enough for them.
+    */
+    int max_layer = 0;
+    if (goal_reachable)
+      max_layer = compute_distances_by_layer_scans(
+        goal_state, projected_operator_costs, filter);
+    allocate_layer_table(max_layer, num_states);
+    if (goal_reachable)
+      compute_distances_by_layer_scans(goal_state, projected_operator_costs, filter);
+  }
+  else if (goal_reachable)
+  {
+    compute_distances_by_dijkstra(goal_state, projected_operator_costs, filter);
+  }
+  compute_dead_states();
+}
 
-  // exercício (b)
+void PatternDatabase::generate_predecessors(
+    int index, const PredecessorFilter &filter, vector<pair<int, int>> &predecessors) const
+{
+  const TNFTask &projected_task = projection.get_projected_task();
+  TNFState state_unranked = projection.unrank_state(index);
+  for (size_t op_id = 0; op_id < projected_task.operators.size(); ++op_id) // pra cada operador
+  {
+    if (filter.operators && !(*filter.operators)[op_id])
+      continue;
+    const TNFOperator &op = projected_task.operators[op_id];
+    bool applicable = true;
+    TNFState new_state(state_unranked); // o estado é uma cópia do estado antigo
+    for (const auto v : op.entries)
+    {
+      if (state_unranked[v.variable_id] != v.effect_value) // se não foi aplicado o efeito tem valor diferente do valor do estado
+      {
+        applicable = false;
+        break;
+      }
+    }
+    if (!applicable)
+      continue;
+    for (const auto v : op.entries)
+    {
+      new_state[v.variable_id] = v.precondition_value; // aplico a pré condição
+    }
+    /*
+      States violating a mutex of the task are not reachable in the
+      original task. We never generate them, so they keep an infinite
+      distance and are treated as dead ends.
+    */
+    bool spurious = false;
+    for (const TNFOperatorEntry &entry : op.entries)
+    {
+      if (projection.violates_mutex(new_state, entry.variable_id, entry.precondition_value))
+      {
+        spurious = true;
+        break;
+      }
+    }
+    if (spurious)
+      continue;
+    int predecessor = projection.rank_state(new_state);
+    if (filter.reachable && !test_bit(*filter.reachable, predecessor))
+      continue;
+    predecessors.emplace_back(op_id, predecessor);
+  }
+}
+
+void PatternDatabase::compute_distances_by_dijkstra(
+    int goal_index, const vector<int> &projected_operator_costs,
+    const PredecessorFilter &filter)
+{
+  auto get_table_index = [this](int index)
+  {
+    return reachable_state_ranks.empty() ? index : get_sparse_table_index(index);
+  };
 
+  /*
+      Priority queues usually order entries so the largest entry is the first.
+      By using the comparator greater<T> instead of the default less<T>, we
+      change the ordering to sort the smallest element first.
+    */
+  priority_queue<QueueEntry, vector<QueueEntry>, greater<QueueEntry>> queue;
+  queue.push({0, goal_index});
+
+  // exercício (b)
+  vector<pair<int, int>> predecessors;
   while (!queue.empty())
   {
     int current_distance = queue.top().first;
     int state = queue.top().second;
     queue.pop();
 
-    if (distances[state] > current_distance) // se vai atualizar a distances pra estado 
+    int &distance = distances[get_table_index(state)];
+    if (distance > current_distance) // se vai atualizar a distances pra estado 
+    {
+      distance = current_distance;
+      predecessors.clear();
+      generate_predecessors(state, filter, predecessors);
+      for (const pair<int, int> &predecessor : predecessors)
+      {
+        queue.push({current_distance + projected_operator_costs[predecessor.first],
+                    predecessor.second});
+      }
+    }
+  }
+}
+
+void PatternDatabase::compute_distances_externally(
+    int goal_index, const vector<int> &projected_operator_costs,
+    const PredecessorFilter &filter, const PDBOptions &options)
+{
+  /*
+    The distance table is a file of ints that is initialized to infinity.
+    Each open list bucket is a file of the states reached with one goal
+    distance g, in the order in which they were generated. The bucket with
+    the smallest g is sorted in runs that fit into memory and the runs are
+    merged, which removes duplicates. A sweep through the table in the same
+    order then removes states with a known distance (delayed duplicate
+    detection) and stores g for the others. Their predecessors are appended
+    to the buckets of their distances. Predecessors via operators of cost 0
+    start a new bucket for g, which is processed next.
+  */
+  utils::Timer timer;
+  IOStatistics statistics;
+  size_t buffer_size = max(options.external_memory_buffer_size, 1024);
+  int num_states = projection.get_projected_task().get_num_states();
+  string directory = create_temporary_directory(options.external_memory_directory);
+  string table_path = directory + "/distances";
+  {
+    IntFileWriter table(table_path, buffer_size, statistics);
+    for (int state = 0; state < num_states; ++state)
+    {
+      table.append(numeric_limits<int>::max());
+    }
+  }
+
+  /*
+    If too many buckets are open for writing, the writer of the bucket with
+    the largest distance is closed. Its file is appended to when the bucket
+    is needed again.
+  */
+  struct Bucket
+  {
+    string path;
+    unique_ptr<IntFileWriter> writer;
+  };
+  map<int, Bucket> buckets;
+  int num_bucket_files = 0;
+  int num_open_writers = 0;
+  auto get_bucket = [&](int distance) -> IntFileWriter &
+  {
+    Bucket &bucket = buckets[distance];
+    if (bucket.path.empty())
+      bucket.path = directory + "/bucket-" + to_string(num_bucket_files++);
+    if (!bucket.writer)
     {
-      distances[state] = current_distance;
-      TNFState state_unranked = projection.unrank_state(state);
-      for (const auto op : projected_task.operators) // pra cada operador
+      if (num_open_writers == MAX_OPEN_BUCKET_WRITERS)
       {
-        bool applicable = true;
-        TNFState new_state(state_unranked); // o estado é uma cópia do estado antigo
-        for (const auto v : op.entries)
+        auto open_bucket = find_if(buckets.rbegin(), buckets.rend(),
+                                   [](const pair<const int, Bucket> &entry)
+                                   { return entry.second.writer != nullptr; });
+        open_bucket->second.writer.reset();
+        --num_open_writers;
+      }
+      bucket.writer = utils::make_unique_ptr<IntFileWriter>(
+        bucket.path, buffer_size / 16, statistics, true);
+      ++num_open_writers;
+    }
+    return *bucket.writer;
+  };
+  if (goal_index != -1)
+    get_bucket(0).append(goal_index);
+
+  string layer_path = directory + "/layer";
+  vector<pair<int, int>> predecessors;
+  while (!buckets.empty())
+  {
+    int distance = buckets.begin()->first;
+    string bucket_path = buckets.begin()->second.path;
+    if (buckets.begin()->second.writer)
+      --num_open_writers;
+    buckets.erase(buckets.begin());
+
+    vector<string> runs = create_sorted_runs(bucket_path, buffer_size, statistics);
+    {
+      IntFileWriter layer(layer_path, buffer_size, statistics);
+      IntFileSweeper table(table_path, buffer_size, statistics);
+      merge_sorted_runs(
+        runs, max<size_t>(buffer_size / max<size_t>(runs.size(), 1), 1024), statistics,
+        [&](int state)
         {
-          if (state_unranked[v.variable_id] != v.effect_value) // se não foi aplicado o efeito tem valor diferente do valor do estado
+          int &entry = table[state];
+          if (entry == numeric_limits<int>::max())
           {
-            applicable = false;
-            break;
+            entry = distance;
+            table.mark_dirty();
+            layer.append(state);
           }
-        }
-        if (applicable) // se o operador for completamente aplicavel eu adiciono na fila
+        });
+    }
+
+    IntFileReader layer(layer_path, buffer_size, statistics);
+    int state;
+    while (layer.next(state))
+    {
+      predecessors.clear();
+      generate_predecessors(state, filter, predecessors);
+      for (const pair<int, int> &predecessor : predecessors)
+      {
+        get_bucket(distance + projected_operator_costs[predecessor.first])
+          .append(predecessor.second);
+      }
+    }
+  }
+  remove_file(layer_path);
+
+  external_distances = utils::make_unique_ptr<MappedIntArray>(table_path, num_states);
+  distance_table = external_distances->data();
+  remove_file(table_path);
+  remove_directory(directory);
+
+  double mib_read = statistics.bytes_read / (1024.0 * 1024.0);
+  double mib_written = statistics.bytes_written / (1024.0 * 1024.0);
+  double time = timer();
+  thread_log << "External PDB construction read " << mib_read << " MiB and wrote "
+        << mib_written << " MiB in " << time << "s ("
+        << (time > 0 ? (mib_read + mib_written) / time : 0) << " MiB/s)" << endl;
+}
+
+bool PatternDatabase::is_distance_known(int index) const
+{
+  if (!distance_mod_3.empty())
+    return get_distance_mod_3(index) != 3;
+  if (!byte_layers.empty())
+    return byte_layers[index] != numeric_limits<uint8_t>::max();
+  if (!short_layers.empty())
+    return short_layers[index] != numeric_limits<uint16_t>::max();
+  if (reachable_state_ranks.empty())
+    return distances[index] != numeric_limits<int>::max();
+  return distances[get_sparse_table_index(index)] != numeric_limits<int>::max();
+}
+
+bool PatternDatabase::is_in_layer(int index, int layer) const
+{
+  if (!distance_mod_3.empty())
+    return get_distance_mod_3(index) == layer % 3;
+  if (!byte_layers.empty())
+    return byte_layers[index] == layer;
+  if (!short_layers.empty())
+    return short_layers[index] == layer;
+  return distances[index] == layer * unit_cost;
+}
+
+void PatternDatabase::set_layer(int index, int layer)
+{
+  if (!distance_mod_3.empty())
+    set_distance_mod_3(index, layer % 3);
+  else if (!byte_layers.empty())
+    byte_layers[index] = static_cast<uint8_t>(layer);
+  else if (!short_layers.empty())
+    short_layers[index] = static_cast<uint16_t>(layer);
+  else if (reachable_state_ranks.empty())
+    distances[index] = layer * unit_cost;
+  else
+    distances[get_sparse_table_index(index)] = layer * unit_cost;
+}
+
+void PatternDatabase::allocate_layer_table(int max_layer, int num_states)
+{
+  distance_mod_3 = vector<uint64_t>();
+  if (max_layer < numeric_limits<uint8_t>::max())
+    byte_layers.assign(num_states, numeric_limits<uint8_t>::max());
+  else if (max_layer < numeric_limits<uint16_t>::max())
+    short_layers.assign(num_states, numeric_limits<uint16_t>::max());
+  else
+    distances.assign(num_states, numeric_limits<int>::max());
+  distance_table = distances.data();
+}
+
+int PatternDatabase::compute_distances_by_layer_scans(
+    int goal_index, const vector<int> &projected_operator_costs,
+    const PredecessorFilter &filter)
+{
+  /*
+    Every layer is completed in two phases: first, states reached by
+    operators of cost 0 are added to the layer until a scan finds no new
+    state. Then the unknown predecessors of the layer via the other
+    operators form the next layer, so these are only regressed once per
+    state. Regressing a forget operator leads to a smaller index, so the
+    scans run downwards to find most of these states in the same scan.
+  */
+  int num_states = projection.get_projected_task().get_num_states();
+  vector<bool> is_zero_cost;
+  vector<bool> is_positive_cost;
+  for (int cost : projected_operator_costs)
+  {
+    is_zero_cost.push_back(cost == 0);
+    is_positive_cost.push_back(cost != 0);
+  }
+  bool has_zero_cost_operators =
+    find(is_zero_cost.begin(), is_zero_cost.end(), true) != is_zero_cost.end();
+  PredecessorFilter zero_cost_filter = filter;
+  zero_cost_filter.operators = &is_zero_cost;
+  PredecessorFilter positive_cost_filter = filter;
+  positive_cost_filter.operators = &is_positive_cost;
+  vector<pair<int, int>> predecessors;
+
+  set_layer(goal_index, 0);
+  for (int layer = 0; ; ++layer)
+  {
+    bool found_new_states = has_zero_cost_operators;
+    while (found_new_states)
+    {
+      found_new_states = false;
+      for (int state = num_states - 1; state >= 0; --state)
+      {
+        if (!is_in_layer(state, layer))
+          continue;
+        predecessors.clear();
+        generate_predecessors(state, zero_cost_filter, predecessors);
+        for (const pair<int, int> &predecessor : predecessors)
         {
-          for(const auto v : op.entries){
-            new_state[v.variable_id] = v.precondition_value; // aplico a pré condição
+          if (!is_distance_known(predecessor.second))
+          {
+            set_layer(predecessor.second, layer);
+            found_new_states = true;
           }
-          queue.push({current_distance + op.cost, projection.rank_state(new_state)});
         }
       }
     }
+
+    bool next_layer_empty = true;
+    for (int state = num_states - 1; state >= 0; --state)
+    {
+      if (!is_in_layer(state, layer))
+        continue;
+      predecessors.clear();
+      generate_predecessors(state, positive_cost_filter, predecessors);
+      for (const pair<int, int> &predecessor : predecessors)
+      {
+        if (!is_distance_known(predecessor.second))
+        {
+          set_layer(predecessor.second, layer + 1);
+          next_layer_empty = false;
+        }
+      }
+    }
+    if (next_layer_empty)
+      return layer;
+  }
+}
+
+void PatternDatabase::compute_dead_states()
+{
+  int num_states = projection.get_projected_task().get_num_states();
+  dead_states.assign((num_states + 63) / 64, 0);
+  int num_dead_states = 0;
+  for (int state = 0; state < num_states; ++state)
+  {
+    if (lookup_index(state) == numeric_limits<int>::max())
+    {
+      set_bit(dead_states, state);
+      ++num_dead_states;
+    }
+  }
+  dead_state_fraction = num_states ? static_cast<double>(num_dead_states) / num_states : 0;
+}
+
+vector<int> PatternDatabase::compute_saturated_costs(int num_operators) const
+{
+  /*
+      The saturated cost of an operator o is the maximum of h(s) - h(t) over
+      all abstract transitions s -o-> t between states with finite goal
+      distance. We enumerate the transitions backwards from each state t like
+      in the regression above. Negative values are clipped to 0.
+    */
+  vector<int> saturated_costs(num_operators, 0);
+  const TNFTask &projected_task = projection.get_projected_task();
+  const vector<int> &operator_ids = projection.get_operator_ids();
+  int num_states = projected_task.get_num_states();
+  for (int state = 0; state < num_states; ++state)
+  {
+    int target_distance = lookup_index(state);
+    if (target_distance == numeric_limits<int>::max())
+      continue;
+    TNFState target = projection.unrank_state(state);
+    for (size_t op_id = 0; op_id < projected_task.operators.size(); ++op_id)
+    {
+      const TNFOperator &op = projected_task.operators[op_id];
+      bool applicable = true;
+      for (const TNFOperatorEntry &entry : op.entries)
+      {
+        if (target[entry.variable_id] != entry.effect_value)
+        {
+          applicable = false;
+          break;
+        }
+      }
+      if (!applicable)
+        continue;
+      TNFState source(target);
+      for (const TNFOperatorEntry &entry : op.entries)
+      {
+        source[entry.variable_id] = entry.precondition_value;
+      }
+      int source_distance = lookup_index(projection.rank_state(source));
+      if (source_distance == numeric_limits<int>::max())
+        continue;
+      int &saturated_cost = saturated_costs[operator_ids[op_id]];
+      saturated_cost = max(saturated_cost, source_distance - target_distance);
+    }
   }
+  return saturated_costs;
+}
+
+void add_pdb_options_to_parser(options::OptionParser &parser)
+{
+  parser.add_option<bool>(
+    "restrict_to_reachable",
+    "only search and store abstract states that are reachable from the "
+    "projected initial state",
+    "false");
+  parser.add_option<bool>(
+    "store_distances_mod_3",
+    "for projections where all operators with positive cost have the same "
+    "cost, only store goal distances modulo 3 (2 bits per abstract state) "
+    "during a first regression and then store the distances in 8 or 16 bits "
+    "per abstract state if they fit",
+    "false");
+  parser.add_option<string>(
+    "external_memory_directory",
+    "build the PDBs with files in this directory instead of in memory and "
+    "map the final tables into memory (empty for in-memory construction)",
+    "");
+  parser.add_option<int>(
+    "external_memory_buffer_size",
+    "number of ints per sorted run and I/O buffer for external construction",
+    "4194304",
+    Bounds("1024", "infinity"));
+}
+
+PDBOptions get_pdb_options(const options::Options &opts)
+{
+  PDBOptions options;
+  options.restrict_to_reachable = opts.get<bool>("restrict_to_reachable");
+  options.store_distances_mod_3 = opts.get<bool>("store_distances_mod_3");
+  options.external_memory_directory = opts.get<string>("external_memory_directory");
+  options.external_memory_buffer_size = opts.get<int>("external_memory_buffer_size");
+  return options;
 }
- // namespace planopt_heuristics
 
-int PatternDatabase::lookup_distance(const TNFState &original_state) const
+PDBCollection build_pattern_databases(
+    const TNFTask &task, const vector<Pattern> &patterns, int num_threads,
+    int max_domain_size, const PDBOptions &options,
+    const atomic<bool> *interrupted)
 {
-  TNFState abstract_state = projection.project_state(original_state);
-  int index = projection.rank_state(abstract_state);
-  return distances[index];
+  int num_patterns = patterns.size();
+  PDBCollection pdbs(num_patterns);
+  /*
+      Every thread repeatedly takes the next pattern that nobody started yet.
+      The threads only read the task and write to different entries of
+      pdbs, so no further synchronization is needed.
+    */
+  atomic<int> next_pattern(0);
+  auto build_next = [&]()
+  {
+    for (int i = next_pattern++; i < num_patterns; i = next_pattern++)
+    {
+      if (interrupted && *interrupted)
+      {
+        return;
+      }
+      pdbs[i] = make_shared<PatternDatabase>(
+        Projection(task, patterns[i],
+                   compute_value_mappings(task, patterns[i], max_domain_size)),
+        options);
+    }
+  };
+
+  num_threads = max(1, min(num_threads, num_patterns));
+  vector<thread> threads;
+  for (int i = 1; i < num_threads; ++i)
+  {
+    threads.emplace_back(build_next);
+  }
+  build_next();
+  for (thread &t : threads)
+  {
+    t.join();
+  }
+  return pdbs;
 }
 }
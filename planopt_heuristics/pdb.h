@@ -1,20 +1,301 @@
 #ifndef PLANOPT_HEURISTICS_PDB_H
 #define PLANOPT_HEURISTICS_PDB_H
 
+#include "external_memory.h"
+#include "huge_page_allocator.h"
 #include "projection.h"
 
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
 #include <vector>
 
+namespace options {
+class OptionParser;
+class Options;
+}
+
 namespace planopt_heuristics {
+struct PDBOptions {
+    /*
+      Only search abstract states reachable from the projected initial state.
+      All other states cannot be reached from the initial state of the task
+      and get an infinite distance. If few states are reachable, only their
+      distances are stored.
+    */
+    bool restrict_to_reachable = false;
+    /*
+      If all operators with positive cost have the same cost, a first
+      breadth-first regression without a queue only stores the goal
+      distances modulo 3 (2 bits per abstract state). This yields the number
+      of layers, so a second regression can store the exact distances in 8
+      or 16 bits per abstract state if they fit. Lookups are as fast as with
+      a full table.
+    */
+    bool store_distances_mod_3 = false;
+    /*
+      If not empty, the regression keeps its open list and the distance
+      table in files in this directory, so only a few buffers have to fit
+      into memory. Lookups use a memory mapping of the final table.
+    */
+    std::string external_memory_directory;
+    // Number of ints per sorted run and per I/O buffer.
+    int external_memory_buffer_size = 1 << 22;
+};
+
+// Number of set bits in the word.
+inline int count_set_bits(uint64_t word) {
+#ifdef __GNUC__
+    return __builtin_popcountll(word);
+#else
+    int num_bits = 0;
+    for (; word; word &= word - 1) {
+        ++num_bits;
+    }
+    return num_bits;
+#endif
+}
 
 class PatternDatabase {
     Projection projection;
-    std::vector<int> distances;
+    std::vector<int, HugePageAllocator<int>> distances;
+    // Table used for lookups: distances or an external table.
+    const int *distance_table;
+    std::unique_ptr<MappedIntArray> external_distances;
+
+    /*
+      Bit i of dead_states is set iff abstract state i has an infinite goal
+      distance. The bitmap is 32 times smaller than the distance table, so
+      dead ends can be detected with few memory accesses.
+    */
+    std::vector<uint64_t> dead_states;
+    double dead_state_fraction;
+
+    /*
+      With a sparse index, distances only has entries for the abstract states
+      reachable from the projected initial state. Bit i of reachable_states
+      is set iff abstract state i is reachable and reachable_state_ranks[w]
+      is the number of reachable states with an index below 64 * w. Both are
+      empty if distances has an entry for every abstract state.
+    */
+    std::vector<uint64_t> reachable_states;
+    std::vector<int> reachable_state_ranks;
+
+    /*
+      During the first regression with store_distances_mod_3, bits 2i and
+      2i+1 of distance_mod_3 hold the goal distance of abstract state i
+      divided by unit_cost modulo 3, or 3 for infinite distances.
+    */
+    std::vector<uint64_t> distance_mod_3;
+    /*
+      If one of them is not empty, distances is empty and it holds the goal
+      distance of each abstract state divided by unit_cost, or the maximal
+      value of its type for infinite distances.
+    */
+    std::vector<uint8_t> byte_layers;
+    std::vector<uint16_t> short_layers;
+    int unit_cost;
+
+    /*
+      If set, this PDB has no tables of its own and looks up the indices of
+      its projection in image_pdb (see the constructor below).
+    */
+    std::shared_ptr<const PatternDatabase> image_pdb;
+
+    int get_distance_mod_3(int index) const {
+        return (distance_mod_3[index >> 5] >> (2 * (index & 31))) & 3;
+    }
+    void set_distance_mod_3(int index, int value) {
+        uint64_t &word = distance_mod_3[index >> 5];
+        int shift = 2 * (index & 31);
+        word = (word & ~(uint64_t(3) << shift)) | (uint64_t(value) << shift);
+    }
+    template<typename Layer>
+    int get_layer_distance(Layer layer) const {
+        if (layer == std::numeric_limits<Layer>::max()) {
+            return std::numeric_limits<int>::max();
+        }
+        return layer * unit_cost;
+    }
+
+    // Position of abstract state index in a sparse table, -1 if not stored.
+    int get_sparse_table_index(int index) const {
+        uint64_t word = reachable_states[index >> 6];
+        uint64_t bit = uint64_t(1) << (index & 63);
+        if (!(word & bit)) {
+            return -1;
+        }
+        return reachable_state_ranks[index >> 6] + count_set_bits(word & (bit - 1));
+    }
+
+    /*
+      Regression from the goal with the given cost of each projected operator.
+      If reachable is not empty, only abstract states with a set bit in it
+      are searched and the others get an infinite distance.
+    */
+    void compute_distances(const std::vector<int> &projected_operator_costs,
+                           const std::vector<uint64_t> &reachable = {},
+                           const PDBOptions &options = PDBOptions());
+
+    // Restrictions on the predecessors generated by the regression.
+    struct PredecessorFilter;
+    /*
+      Append the pairs (projected operator id, predecessor index) for all
+      predecessors of the abstract state with the given index.
+    */
+    void generate_predecessors(int index, const PredecessorFilter &filter,
+                               std::vector<std::pair<int, int>> &predecessors) const;
+    void compute_distances_by_dijkstra(
+        int goal_index, const std::vector<int> &projected_operator_costs,
+        const PredecessorFilter &filter);
+    /*
+      Breadth-first regression for projections where all operators with
+      positive costs cost unit_cost. Instead of a queue, the states of each
+      layer are found by scanning all abstract states with is_in_layer().
+      States reached by operators with cost 0 join the current layer.
+      Returns the index of the last layer.
+    */
+    int compute_distances_by_layer_scans(
+        int goal_index, const std::vector<int> &projected_operator_costs,
+        const PredecessorFilter &filter);
+    /*
+      Regression with delayed duplicate detection: the open list consists of
+      one file per goal distance, which is sorted on disk before the states
+      with this distance are checked against the distance table file.
+    */
+    void compute_distances_externally(
+        int goal_index, const std::vector<int> &projected_operator_costs,
+        const PredecessorFilter &filter, const PDBOptions &options);
+    bool is_distance_known(int index) const;
+    /*
+      With distance_mod_3, this is also true for the states of the layers
+      layer - 3, layer - 6, ... which have no unknown predecessors left.
+    */
+    bool is_in_layer(int index, int layer) const;
+    void set_layer(int index, int layer);
+    // Replace the modulo 3 marks by the smallest table for the given layers.
+    void allocate_layer_table(int max_layer, int num_states);
+    // Bitmap of the abstract states reachable from the projected initial state.
+    std::vector<uint64_t> compute_reachable_states() const;
+    void compute_dead_states();
 public:
     PatternDatabase(const TNFTask &task, const Pattern &pattern);
+    // Compute the PDB of a given projection or domain abstraction.
+    explicit PatternDatabase(Projection &&abstraction,
+                             const PDBOptions &options = PDBOptions());
+    /*
+      Compute the PDB under a different cost function. operator_costs has one
+      entry for each operator of the original task.
+    */
+    PatternDatabase(const TNFTask &task, const Pattern &pattern,
+                    const std::vector<int> &operator_costs);
+    /*
+      PDB that shares the tables of image_pdb. The projection must rank
+      abstract states like the projection of image_pdb ranks their images
+      under a task symmetry (see create_symmetric_projection()).
+    */
+    PatternDatabase(Projection &&symmetric_projection,
+                    const std::shared_ptr<const PatternDatabase> &image_pdb);
 
-    int lookup_distance(const TNFState &original_state) const;
+    // distance_table points into the own tables, so PDBs are not copied.
+    PatternDatabase(const PatternDatabase &) = delete;
+    PatternDatabase &operator=(const PatternDatabase &) = delete;
+
+    template<typename State>
+    int lookup_distance(const State &original_state) const {
+        return lookup_index(compute_index(original_state));
+    }
+
+    // Rank of the abstract state of original_state.
+    template<typename State>
+    int compute_index(const State &original_state) const {
+        return projection.rank_original_state(original_state);
+    }
+    int lookup_index(int index) const {
+        if (image_pdb) {
+            return image_pdb->lookup_index(index);
+        }
+        if (reachable_state_ranks.empty()) {
+            if (!byte_layers.empty()) {
+                return get_layer_distance(byte_layers[index]);
+            }
+            if (!short_layers.empty()) {
+                return get_layer_distance(short_layers[index]);
+            }
+            return distance_table[index];
+        }
+        int table_index = get_sparse_table_index(index);
+        if (table_index == -1) {
+            return std::numeric_limits<int>::max();
+        }
+        return distance_table[table_index];
+    }
+    bool is_dead_index(int index) const {
+        if (image_pdb) {
+            return image_pdb->is_dead_index(index);
+        }
+        return (dead_states[index >> 6] >> (index & 63)) & 1;
+    }
+    // Fraction of abstract states with infinite goal distance.
+    double get_dead_state_fraction() const {
+        return dead_state_fraction;
+    }
+    // Hint that the entry of the given index will be looked up soon.
+    void prefetch_index(int index) const {
+#ifdef __GNUC__
+        if (image_pdb) {
+            image_pdb->prefetch_index(index);
+        } else if (!byte_layers.empty()) {
+            __builtin_prefetch(&byte_layers[index]);
+        } else if (!short_layers.empty()) {
+            __builtin_prefetch(&short_layers[index]);
+        } else if (reachable_state_ranks.empty()) {
+            __builtin_prefetch(&distance_table[index]);
+        } else {
+            __builtin_prefetch(&reachable_states[index >> 6]);
+        }
+#else
+        (void)index;
+#endif
+    }
+
+    /*
+      Return the minimal cost of each operator of the original task that
+      preserves all distances in this PDB. These costs are 0 for operators
+      that do not affect the projection.
+    */
+    std::vector<int> compute_saturated_costs(int num_operators) const;
+
+    const Projection &get_projection() const {
+        return projection;
+    }
+    // True if the tables are shared with the PDB of a symmetric pattern.
+    bool shares_tables() const {
+        return image_pdb != nullptr;
+    }
 };
+
+using PDBCollection = std::vector<std::shared_ptr<PatternDatabase>>;
+
+// Add the options of PDBOptions to the parser.
+extern void add_pdb_options_to_parser(options::OptionParser &parser);
+// Read the options added by add_pdb_options_to_parser().
+extern PDBOptions get_pdb_options(const options::Options &opts);
+
+/*
+  Build the PDBs for all patterns, distributing the patterns over num_threads
+  threads. The PDBs are returned in the order of the patterns. Variables with
+  more than max_domain_size values are abstracted with a domain abstraction.
+  If *interrupted becomes true, no further PDBs are started and the entries
+  of the PDBs that were not built stay nullptr.
+*/
+extern PDBCollection build_pattern_databases(
+    const TNFTask &task, const std::vector<Pattern> &patterns, int num_threads,
+    int max_domain_size = std::numeric_limits<int>::max(),
+    const PDBOptions &options = PDBOptions(),
+    const std::atomic<bool> *interrupted = nullptr);
 }
 
 #endif
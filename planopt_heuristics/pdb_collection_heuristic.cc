@@ -0,0 +1,148 @@
+#include "pdb_collection_heuristic.h"
+
+#include "../option_parser.h"
+
+using namespace std;
+
+namespace planopt_heuristics {
+PDBCollectionHeuristic::PDBCollectionHeuristic(const options::Options &options)
+    : Heuristic(options),
+      incremental_indices(options.get<bool>("incremental_indices")),
+      clique_pruning_warm_up(options.get<int>("clique_pruning_warm_up")),
+      active_version(-1),
+      tnf_task(create_tnf_task(task_proxy)) {
+}
+
+PDBCollectionHeuristic::~PDBCollectionHeuristic() {
+    if (active_cpdbs) {
+        active_cpdbs->print_clique_pruning_statistics();
+    }
+}
+
+void PDBCollectionHeuristic::prepare_cpdbs(CanonicalPatternDatabases &new_cpdbs) const {
+    if (incremental_indices) {
+        new_cpdbs.prepare_incremental_indices(tnf_task);
+    }
+    if (clique_pruning_warm_up > 0) {
+        new_cpdbs.enable_clique_pruning(clique_pruning_warm_up);
+    }
+}
+
+void PDBCollectionHeuristic::set_cpdbs(unique_ptr<CanonicalPatternDatabases> new_cpdbs) {
+    prepare_cpdbs(*new_cpdbs);
+    cpdbs.swap(move(new_cpdbs));
+}
+
+void PDBCollectionHeuristic::start_background_construction(const CPDBsBuilder &build) {
+    cpdbs.start_background_construction(
+        [this, build](const atomic<bool> &interrupted) {
+            unique_ptr<CanonicalPatternDatabases> new_cpdbs = build(interrupted);
+            if (new_cpdbs) {
+                prepare_cpdbs(*new_cpdbs);
+            }
+            return new_cpdbs;
+        });
+}
+
+void PDBCollectionHeuristic::update_active_cpdbs() {
+    cpdbs.flush_log();
+    int version = cpdbs.get_version();
+    if (version != active_version) {
+        // The statistics of a replaced collection would be lost otherwise.
+        if (active_cpdbs) {
+            active_cpdbs->print_clique_pruning_statistics();
+        }
+        active_cpdbs = cpdbs.get();
+        active_version = version;
+    }
+}
+
+void PDBCollectionHeuristic::compute_abstract_indices(
+    const GlobalState &state, VersionedIndices &entry) {
+    active_cpdbs->compute_abstract_indices(state.get_values(), entry.indices);
+    entry.version = active_version;
+}
+
+void PDBCollectionHeuristic::get_path_dependent_evaluators(set<Evaluator *> &evals) {
+    if (incremental_indices) {
+        evals.insert(this);
+    }
+}
+
+void PDBCollectionHeuristic::notify_initial_state(const GlobalState &initial_state) {
+    if (incremental_indices) {
+        update_active_cpdbs();
+        compute_abstract_indices(initial_state, abstract_indices[initial_state]);
+    }
+}
+
+void PDBCollectionHeuristic::notify_state_transition(
+    const GlobalState &parent_state, OperatorID op_id, const GlobalState &state) {
+    if (!incremental_indices) {
+        return;
+    }
+    update_active_cpdbs();
+    VersionedIndices &entry = abstract_indices[state];
+    if (entry.version == active_version) {
+        // The state was reached before and its indices do not change.
+        return;
+    }
+    const VersionedIndices &parent_entry = abstract_indices[parent_state];
+    if (parent_entry.version == active_version) {
+        active_cpdbs->compute_successor_indices(
+            parent_entry.indices, parent_state, op_id.get_index(), entry.indices);
+        entry.version = active_version;
+    } else {
+        compute_abstract_indices(state, entry);
+    }
+}
+
+int PDBCollectionHeuristic::compute_heuristic(const GlobalState &global_state) {
+    update_active_cpdbs();
+    int h;
+    if (incremental_indices) {
+        VersionedIndices &entry = abstract_indices[global_state];
+        if (entry.version != active_version) {
+            compute_abstract_indices(global_state, entry);
+        }
+        h = active_cpdbs->compute_heuristic_from_indices(entry.indices);
+    } else {
+        TNFState state = global_state.get_values();
+        h = active_cpdbs->compute_heuristic(state);
+    }
+
+    if (h == numeric_limits<int>::max()) {
+        return DEAD_END;
+    } else {
+        return h;
+    }
+}
+
+void PDBCollectionHeuristic::add_options_to_parser(options::OptionParser &parser) {
+    Heuristic::add_options_to_parser(parser);
+    parser.add_option<bool>(
+        "incremental_indices",
+        "store the abstract indices of evaluated states and compute the "
+        "indices of successors incrementally",
+        "false");
+    parser.add_option<int>(
+        "clique_pruning_warm_up",
+        "number of evaluations after which cliques that were never maximal "
+        "are no longer evaluated (0 disables clique pruning)",
+        "0",
+        Bounds("0", "infinity"));
+    parser.add_option<bool>(
+        "background_construction",
+        "start the search with the PDBs of the goal variables and build the "
+        "actual collection in a background thread",
+        "false");
+}
+
+vector<Pattern> get_goal_variable_singletons(const TaskProxy &task_proxy) {
+    vector<Pattern> patterns;
+    for (FactProxy goal : task_proxy.get_goals()) {
+        patterns.push_back({goal.get_variable().get_id()});
+    }
+    return patterns;
+}
+}
@@ -0,0 +1,66 @@
+#ifndef PLANOPT_HEURISTICS_PDB_COLLECTION_HEURISTIC_H
+#define PLANOPT_HEURISTICS_PDB_COLLECTION_HEURISTIC_H
+
+#include "swappable_cpdbs.h"
+
+#include "../heuristic.h"
+#include "../per_state_information.h"
+
+#include <memory>
+#include <vector>
+
+namespace planopt_heuristics {
+/*
+  Abstract indices of all PDBs of the collection with the given version for
+  one state.
+*/
+struct VersionedIndices {
+    int version = -1;
+    std::vector<int> indices;
+};
+
+/*
+  Base class for heuristics that evaluate a collection of PDBs with the
+  canonical heuristic. The collection can be replaced during search, e.g. by a
+  collection that was built in the background.
+*/
+class PDBCollectionHeuristic : public Heuristic {
+    bool incremental_indices;
+    int clique_pruning_warm_up;
+    // Abstract indices of all PDBs for evaluated states (if enabled).
+    PerStateInformation<VersionedIndices> abstract_indices;
+
+    // Collection used for the current evaluation and its version.
+    std::shared_ptr<const CanonicalPatternDatabases> active_cpdbs;
+    int active_version;
+
+    void prepare_cpdbs(CanonicalPatternDatabases &new_cpdbs) const;
+    void update_active_cpdbs();
+    void compute_abstract_indices(const GlobalState &state, VersionedIndices &entry);
+protected:
+    const TNFTask tnf_task;
+    // Declared after tnf_task, so background threads using it stop first.
+    SwappableCanonicalPDBs cpdbs;
+
+    void set_cpdbs(std::unique_ptr<CanonicalPatternDatabases> new_cpdbs);
+    void start_background_construction(const CPDBsBuilder &build);
+
+    virtual int compute_heuristic(const GlobalState &state) override;
+public:
+    explicit PDBCollectionHeuristic(const options::Options &options);
+    // Reports the clique pruning statistics of the last collection.
+    virtual ~PDBCollectionHeuristic() override;
+
+    virtual void get_path_dependent_evaluators(std::set<Evaluator *> &evals) override;
+    virtual void notify_initial_state(const GlobalState &initial_state) override;
+    virtual void notify_state_transition(
+        const GlobalState &parent_state, OperatorID op_id,
+        const GlobalState &state) override;
+
+    static void add_options_to_parser(options::OptionParser &parser);
+};
+
+// Singleton patterns of the goal variables of the task.
+extern std::vector<Pattern> get_goal_variable_singletons(const TaskProxy &task_proxy);
+}
+#endif
@@ -1,10 +1,26 @@
 #include "projection.h"
 
+#include <algorithm>
+#include <cassert>
+
 using namespace std;
 
 namespace planopt_heuristics {
 Projection::Projection(const TNFTask &task, const Pattern &pattern)
-    : pattern(pattern) {
+    : Projection(task, pattern, {}) {
+}
+
+Projection::Projection(const TNFTask &task, const Pattern &pattern,
+                       const vector<ValueMapping> &value_mappings)
+    : Projection(task, pattern, value_mappings, {}) {
+}
+
+Projection::Projection(const TNFTask &task, const Pattern &pattern,
+                       const vector<ValueMapping> &value_mappings,
+                       const vector<int> &multipliers)
+    : pattern(pattern),
+      value_mappings(value_mappings),
+      perfect_hash_multipliers(multipliers) {
     /*
       Create variables and remember mapping between variables in the original
       and the projected task.
@@ -21,6 +37,10 @@ Projection::Projection(const TNFTask &task, const Pattern &pattern)
     for (int pattern_var_id : pattern) {
         variable_mapping[pattern_var_id] = var_id;
         int domain_size = task.variable_domains[pattern_var_id];
+        if (!value_mappings.empty()) {
+            const ValueMapping &value_mapping = value_mappings[var_id];
+            domain_size = *max_element(value_mapping.begin(), value_mapping.end()) + 1;
+        }
         projected_task.variable_domains.push_back(domain_size);
         ++var_id;
     }
@@ -28,11 +48,14 @@ Projection::Projection(const TNFTask &task, const Pattern &pattern)
     /*
       Compute multipliers for ranking/unranking states.
     */
-    int multiplier = 1;
-    for (size_t i = 0; i < pattern.size(); ++i) {
-        perfect_hash_multipliers.push_back(multiplier);
-        multiplier *= projected_task.variable_domains[i];
+    if (perfect_hash_multipliers.empty()) {
+        int multiplier = 1;
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            perfect_hash_multipliers.push_back(multiplier);
+            multiplier *= projected_task.variable_domains[i];
+        }
     }
+    assert(perfect_hash_multipliers.size() == pattern.size());
 
     /*
       Project initial state and goal state, and set
@@ -40,6 +63,8 @@ Projection::Projection(const TNFTask &task, const Pattern &pattern)
     */
 
     // TODO: add your code for exercise (a) here.
+    select_rank_function();
+
     projected_task.initial_state = project_state(task.initial_state);
     projected_task.goal_state = project_state(task.goal_state);
 
@@ -53,28 +78,166 @@ Projection::Projection(const TNFTask &task, const Pattern &pattern)
    
 
     vector<TNFOperator> projected_operators;
-    for( TNFOperator op : task.operators){
+    for(size_t op_id = 0; op_id < task.operators.size(); ++op_id){
+        const TNFOperator &op = task.operators[op_id];
         vector<TNFOperatorEntry> projected_entries;
         for(TNFOperatorEntry entry: op.entries){
 	    if(find(pattern.begin(), pattern.end(), entry.variable_id) != pattern.end()){
-                projected_entries.emplace_back(TNFOperatorEntry(variable_mapping[entry.variable_id], entry.precondition_value, entry.effect_value));
+                int projected_var = variable_mapping[entry.variable_id];
+                projected_entries.emplace_back(TNFOperatorEntry(projected_var,
+                    get_abstract_value(projected_var, entry.precondition_value),
+                    get_abstract_value(projected_var, entry.effect_value)));
             }
         }
         if(projected_entries.size() != 0){
             projected_operators.push_back(TNFOperator(projected_entries, op.cost, op.name));
+            operator_ids.push_back(op_id);
         }
     }
 
 
     projected_task.operators = projected_operators;
 
+    /*
+      Project mutex groups. Only facts of variables in the pattern are kept and
+      groups with less than two facts are dropped. In domain abstractions, an
+      abstract fact that represents several values is not mutex with anything,
+      so we only keep facts whose abstract value represents only them.
+    */
+    vector<vector<int>> num_represented_values(pattern.size());
+    for (size_t var_id = 0; var_id < pattern.size(); ++var_id) {
+        num_represented_values[var_id].assign(projected_task.variable_domains[var_id], 0);
+        for (int value = 0; value < task.variable_domains[pattern[var_id]]; ++value) {
+            ++num_represented_values[var_id][get_abstract_value(var_id, value)];
+        }
+    }
+    mutex_partners.resize(pattern.size());
+    for (size_t var_id = 0; var_id < pattern.size(); ++var_id) {
+        mutex_partners[var_id].resize(projected_task.variable_domains[var_id]);
+    }
+    for (const vector<FactPair> &group : task.mutex_groups) {
+        vector<FactPair> projected_group;
+        for (const FactPair &fact : group) {
+            int projected_var = variable_mapping[fact.var];
+            if (projected_var == -1) {
+                continue;
+            }
+            int abstract_value = get_abstract_value(projected_var, fact.value);
+            if (num_represented_values[projected_var][abstract_value] == 1) {
+                projected_group.emplace_back(projected_var, abstract_value);
+            }
+        }
+        if (projected_group.size() < 2) {
+            continue;
+        }
+        for (const FactPair &fact : projected_group) {
+            for (const FactPair &other : projected_group) {
+                if (fact.var != other.var) {
+                    mutex_partners[fact.var][fact.value].push_back(other);
+                }
+            }
+        }
+        projected_task.mutex_groups.push_back(projected_group);
+    }
+
+}
+
+template<int PatternSize>
+int Projection::rank_unrolled(const Projection &projection, const int *values) {
+    const int *pattern = projection.pattern.data();
+    const int *multipliers = projection.perfect_hash_multipliers.data();
+    int index = 0;
+    for (int i = 0; i < PatternSize; ++i) {
+        index += multipliers[i] * values[pattern[i]];
+    }
+    return index;
+}
+
+template<int PatternSize>
+int Projection::rank_shifted(const Projection &projection, const int *values) {
+    const int *pattern = projection.pattern.data();
+    const int *shifts = projection.perfect_hash_shifts.data();
+    int index = 0;
+    for (int i = 0; i < PatternSize; ++i) {
+        index |= values[pattern[i]] << shifts[i];
+    }
+    return index;
+}
+
+int Projection::rank_generic(const Projection &projection, const int *values) {
+    int index = 0;
+    for (size_t i = 0; i < projection.pattern.size(); ++i) {
+        index += projection.perfect_hash_multipliers[i] * values[projection.pattern[i]];
+    }
+    return index;
+}
+
+int Projection::rank_shifted_generic(const Projection &projection, const int *values) {
+    int index = 0;
+    for (size_t i = 0; i < projection.pattern.size(); ++i) {
+        index |= values[projection.pattern[i]] << projection.perfect_hash_shifts[i];
+    }
+    return index;
+}
+
+int Projection::rank_mapped(const Projection &projection, const int *values) {
+    int index = 0;
+    for (size_t i = 0; i < projection.pattern.size(); ++i) {
+        index += projection.perfect_hash_multipliers[i] *
+            projection.value_mappings[i][values[projection.pattern[i]]];
+    }
+    return index;
+}
+
+void Projection::select_rank_function() {
+    if (!value_mappings.empty()) {
+        rank_function = rank_mapped;
+        return;
+    }
+
+    /*
+      If all domain sizes are powers of two, all multipliers are powers of two
+      and the ranks of the values occupy disjoint bits of the index.
+    */
+    bool all_powers_of_two = true;
+    for (int domain_size : projected_task.variable_domains) {
+        if ((domain_size & (domain_size - 1)) != 0) {
+            all_powers_of_two = false;
+        }
+    }
+    if (all_powers_of_two) {
+        for (int multiplier : perfect_hash_multipliers) {
+            int shift = 0;
+            while ((1 << shift) < multiplier) {
+                ++shift;
+            }
+            perfect_hash_shifts.push_back(shift);
+        }
+    }
+
+    static const RankFunction unrolled[] = {
+        rank_unrolled<0>, rank_unrolled<1>, rank_unrolled<2>, rank_unrolled<3>,
+        rank_unrolled<4>, rank_unrolled<5>, rank_unrolled<6>, rank_unrolled<7>,
+        rank_unrolled<8>};
+    static const RankFunction shifted[] = {
+        rank_shifted<0>, rank_shifted<1>, rank_shifted<2>, rank_shifted<3>,
+        rank_shifted<4>, rank_shifted<5>, rank_shifted<6>, rank_shifted<7>,
+        rank_shifted<8>};
+    const int max_unrolled_size = 8;
+
+    int pattern_size = pattern.size();
+    if (pattern_size <= max_unrolled_size) {
+        rank_function = all_powers_of_two ? shifted[pattern_size] : unrolled[pattern_size];
+    } else {
+        rank_function = all_powers_of_two ? rank_shifted_generic : rank_generic;
+    }
 }
 
 TNFState Projection::project_state(const TNFState &original_state) const {
     int num_abstract_variables = pattern.size();
     TNFState abstract_state(num_abstract_variables, -1);
     for (size_t var_id = 0; var_id < pattern.size(); ++var_id) {
-        abstract_state[var_id] = original_state[pattern[var_id]];
+        abstract_state[var_id] = get_abstract_value(var_id, original_state[pattern[var_id]]);
     }
     return abstract_state;
 }
@@ -90,12 +253,58 @@ int Projection::rank_state(const TNFState &state) const {
 
 
 TNFState Projection::unrank_state(int index) const {
+    // The multipliers need not increase with i (see constructor).
     vector<int> values(pattern.size());
-    for (int i = pattern.size() - 1; i >= 0; --i) {
-        values[i] = index / perfect_hash_multipliers[i];
-        index -= values[i] * perfect_hash_multipliers[i];
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        values[i] = index / perfect_hash_multipliers[i] % projected_task.variable_domains[i];
     }
-    assert(index == 0);
     return values;
 }
+
+vector<ValueMapping> compute_value_mappings(
+    const TNFTask &task, const Pattern &pattern, int max_domain_size) {
+    assert(max_domain_size >= 2);
+    bool needs_abstraction = false;
+    for (int var_id : pattern) {
+        if (task.variable_domains[var_id] > max_domain_size) {
+            needs_abstraction = true;
+        }
+    }
+    if (!needs_abstraction) {
+        return {};
+    }
+
+    vector<ValueMapping> value_mappings;
+    value_mappings.reserve(pattern.size());
+    for (int var_id : pattern) {
+        int domain_size = task.variable_domains[var_id];
+        ValueMapping value_mapping(domain_size);
+        if (domain_size <= max_domain_size) {
+            for (int value = 0; value < domain_size; ++value) {
+                value_mapping[value] = value;
+            }
+        } else {
+            /*
+              The goal value gets abstract value 0. The other values are
+              distributed over the abstract values 1, ..., max_domain_size - 1
+              in blocks of consecutive values.
+            */
+            int goal_value = task.goal_state[var_id];
+            int num_other_values = domain_size - 1;
+            int num_blocks = max_domain_size - 1;
+            int other_value_index = 0;
+            for (int value = 0; value < domain_size; ++value) {
+                if (value == goal_value) {
+                    value_mapping[value] = 0;
+                } else {
+                    value_mapping[value] =
+                        1 + other_value_index * num_blocks / num_other_values;
+                    ++other_value_index;
+                }
+            }
+        }
+        value_mappings.push_back(move(value_mapping));
+    }
+    return value_mappings;
+}
 }
@@ -3,15 +3,43 @@
 
 #include "tnf_task.h"
 
+#include <functional>
 #include <vector>
 
 namespace planopt_heuristics {
 
 using Pattern = std::vector<int>;
 
+struct PatternHash {
+    std::size_t operator()(const Pattern &pattern) const {
+        std::size_t hash = pattern.size();
+        for (int var_id : pattern) {
+            hash ^= std::hash<int>()(var_id) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        }
+        return hash;
+    }
+};
+
+/*
+  Maps each value of a variable to an abstract value. The abstract values of a
+  variable with k abstract values are 0, ..., k-1.
+*/
+using ValueMapping = std::vector<int>;
+
+/*
+  A projection keeps the variables of the pattern and drops all others. If
+  value mappings are given, it is a domain abstraction: the values of each
+  pattern variable are additionally mapped to fewer abstract values.
+*/
 class Projection {
     Pattern pattern;
 
+    /*
+      Empty for plain projections. Otherwise, value_mappings[i] maps the values
+      of variable pattern[i] to the values of variable i of the projected task.
+    */
+    std::vector<ValueMapping> value_mappings;
+
     /*
       Multipliers for perfect hashing. In the slides, these are called N_i.
     */
@@ -19,16 +47,118 @@ class Projection {
 
     TNFTask projected_task;
 
+    /*
+      Index of the operator in the original task for each operator of the
+      projected task.
+    */
+    std::vector<int> operator_ids;
+
+    /*
+      mutex_partners[v][d] lists the facts of the projected task that are
+      mutex with the fact v=d of the projected task.
+    */
+    std::vector<std::vector<std::vector<FactPair>>> mutex_partners;
+
+    /*
+      Ranking of original states is dispatched once at construction to a
+      kernel specialized for the pattern: fully unrolled loops for small
+      patterns and shifts instead of multiplications if all domain sizes are
+      powers of two. perfect_hash_shifts[i] is log2(perfect_hash_multipliers[i])
+      in the latter case.
+    */
+    using RankFunction = int (*)(const Projection &projection, const int *values);
+    RankFunction rank_function;
+    std::vector<int> perfect_hash_shifts;
+
+    template<int PatternSize>
+    static int rank_unrolled(const Projection &projection, const int *values);
+    template<int PatternSize>
+    static int rank_shifted(const Projection &projection, const int *values);
+    static int rank_generic(const Projection &projection, const int *values);
+    static int rank_shifted_generic(const Projection &projection, const int *values);
+    static int rank_mapped(const Projection &projection, const int *values);
+    void select_rank_function();
+
 public:
     Projection(const TNFTask &task, const Pattern &pattern);
+    Projection(const TNFTask &task, const Pattern &pattern,
+               const std::vector<ValueMapping> &value_mappings);
+    /*
+      Use the given perfect hash multipliers instead of the default ones,
+      e.g., to rank abstract states like another projection (see
+      create_symmetric_projection()). The multipliers must be a permutation
+      of the default ones for some order of the pattern variables.
+    */
+    Projection(const TNFTask &task, const Pattern &pattern,
+               const std::vector<ValueMapping> &value_mappings,
+               const std::vector<int> &multipliers);
+
+    bool is_domain_abstraction() const {
+        return !value_mappings.empty();
+    }
+    int get_abstract_value(int pattern_index, int value) const {
+        return value_mappings.empty() ? value : value_mappings[pattern_index][value];
+    }
 
     TNFState project_state(const TNFState &state) const;
     int rank_state(const TNFState &state) const;
     TNFState unrank_state(int index) const;
 
+    /*
+      Rank the projection of a state of the original task without creating
+      the abstract state. State can be anything that gives the value of
+      variable i with operator[].
+    */
+    int rank_original_state(const TNFState &original_state) const {
+        return rank_function(*this, original_state.data());
+    }
+    template<typename State>
+    int rank_original_state(const State &original_state) const {
+        int index = 0;
+        if (value_mappings.empty()) {
+            for (size_t i = 0; i < pattern.size(); ++i) {
+                index += perfect_hash_multipliers[i] * original_state[pattern[i]];
+            }
+        } else {
+            for (size_t i = 0; i < pattern.size(); ++i) {
+                index += perfect_hash_multipliers[i] *
+                    value_mappings[i][original_state[pattern[i]]];
+            }
+        }
+        return index;
+    }
+
+    // True if var=value is mutex with another fact of the abstract state.
+    bool violates_mutex(const TNFState &abstract_state, int var, int value) const {
+        for (const FactPair &fact : mutex_partners[var][value]) {
+            if (abstract_state[fact.var] == fact.value) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     const TNFTask &get_projected_task() { return projected_task; }
+    const TNFTask &get_projected_task() const { return projected_task; }
+    const Pattern &get_pattern() const { return pattern; }
+    const std::vector<int> &get_operator_ids() const { return operator_ids; }
+    const std::vector<ValueMapping> &get_value_mappings() const { return value_mappings; }
+    const std::vector<int> &get_perfect_hash_multipliers() const {
+        return perfect_hash_multipliers;
+    }
 
 };
+
+/*
+  Compute value mappings for a domain abstraction of the pattern with at most
+  max_domain_size abstract values per variable. The goal value of a variable
+  keeps its own abstract value, the remaining values are split into blocks of
+  consecutive values. Variables with small enough domains keep all values. If
+  no variable needs to be abstracted, the result is empty, i.e., the
+  abstraction is a plain projection.
+*/
+extern std::vector<ValueMapping> compute_value_mappings(
+    const TNFTask &task, const Pattern &pattern, int max_domain_size);
 }
 
 #endif
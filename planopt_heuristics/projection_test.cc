@@ -1,5 +1,6 @@
 #include "projection_test.h"
 
+#include "pdb.h"
 #include "projection.h"
 #include "tnf_task.h"
 
@@ -115,6 +116,30 @@ void verify_tasks_match(TNFTask task, TNFTask expected) {
     }
 }
 
+/*
+  Distances stored modulo 3 during construction (breadth-first regression)
+  must match those of the default construction (Dijkstra).
+*/
+void verify_pdb_constructions_match(const TNFTask &task, const Pattern &pattern) {
+    PatternDatabase dijkstra_pdb(Projection(task, pattern));
+    PDBOptions options;
+    options.store_distances_mod_3 = true;
+    PatternDatabase layered_pdb(Projection(task, pattern), options);
+    int num_states = dijkstra_pdb.get_projection().get_projected_task().get_num_states();
+    bool distances_match = true;
+    for (int index = 0; index < num_states; ++index) {
+        if (layered_pdb.lookup_index(index) != dijkstra_pdb.lookup_index(index)) {
+            cerr << "Abstract state " << index << " should have goal distance "
+                 << dijkstra_pdb.lookup_index(index) << " but has goal distance "
+                 << layered_pdb.lookup_index(index) << endl;
+            distances_match = false;
+        }
+    }
+    if (distances_match) {
+        cout << "Distances are as expected." << endl;
+    }
+}
+
 void test_projections() {
     TNFTask task;
     int var_package = 0;
@@ -202,5 +227,11 @@ void test_projections() {
     };
     cout << "verifying projection to truck A and package:" << endl;
     verify_tasks_match(p2.get_projected_task(), expected2);
+    cout << endl;
+
+    cout << "Verifying breadth-first PDB construction:" << endl;
+    verify_pdb_constructions_match(task, {var_package});
+    verify_pdb_constructions_match(task, {var_truck_a, var_package});
+    verify_pdb_constructions_match(task, {var_package, var_truck_a, var_truck_b});
 }
 }
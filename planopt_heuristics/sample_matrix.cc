@@ -0,0 +1,61 @@
+#include "sample_matrix.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace planopt_heuristics {
+template<typename Value>
+static void add_column_to_indices(
+    const Value *column, int multiplier, int num_values, int *indices) {
+    for (int i = 0; i < num_values; ++i) {
+        indices[i] += multiplier * column[i];
+    }
+}
+
+template<typename Value>
+void SampleMatrix::fill_columns(
+    const vector<TNFState> &samples, int num_variables, vector<Value> &values) {
+    int num_samples = samples.size();
+    values.resize(static_cast<size_t>(num_variables) * num_samples);
+    for (int sample_id = 0; sample_id < num_samples; ++sample_id) {
+        const TNFState &sample = samples[sample_id];
+        for (int var_id = 0; var_id < num_variables; ++var_id) {
+            values[var_id * num_samples + sample_id] = sample[var_id];
+        }
+    }
+}
+
+SampleMatrix::SampleMatrix(
+    const vector<int> &variable_domains, const vector<TNFState> &samples)
+    : num_samples(samples.size()),
+      num_variables(variable_domains.size()) {
+    int max_domain_size = 0;
+    for (int domain_size : variable_domains) {
+        max_domain_size = max(max_domain_size, domain_size);
+    }
+    if (num_samples == 0 || num_variables == 0) {
+        return;
+    } else if (max_domain_size <= numeric_limits<uint8_t>::max() + 1) {
+        fill_columns(samples, num_variables, values_8);
+    } else if (max_domain_size <= numeric_limits<uint16_t>::max() + 1) {
+        fill_columns(samples, num_variables, values_16);
+    } else {
+        fill_columns(samples, num_variables, values_32);
+    }
+}
+
+void SampleMatrix::add_to_indices(
+    int var_id, int multiplier, int begin, int end, int *indices) const {
+    int offset = var_id * num_samples + begin;
+    int num_values = end - begin;
+    if (!values_8.empty()) {
+        add_column_to_indices(values_8.data() + offset, multiplier, num_values, indices);
+    } else if (!values_16.empty()) {
+        add_column_to_indices(values_16.data() + offset, multiplier, num_values, indices);
+    } else {
+        add_column_to_indices(values_32.data() + offset, multiplier, num_values, indices);
+    }
+}
+}
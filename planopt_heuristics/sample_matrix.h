@@ -0,0 +1,81 @@
+#ifndef PLANOPT_HEURISTICS_SAMPLE_MATRIX_H
+#define PLANOPT_HEURISTICS_SAMPLE_MATRIX_H
+
+#include "tnf_task.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace planopt_heuristics {
+class SampleMatrix;
+
+/*
+  Read-only view of one sample in a SampleMatrix. Like a TNFState, it gives
+  the value of variable i with operator[].
+*/
+class SampleView {
+    const SampleMatrix *matrix;
+    int sample_id;
+public:
+    SampleView(const SampleMatrix &matrix, int sample_id)
+        : matrix(&matrix), sample_id(sample_id) {
+    }
+
+    int operator[](int var_id) const;
+};
+
+/*
+  Stores a set of states column by column: all values of variable 0 come
+  first, then all values of variable 1, and so on. Values are stored with the
+  smallest integer width that fits all variable domains.
+*/
+class SampleMatrix {
+    int num_samples;
+    int num_variables;
+    // Only the vector matching the value width is used.
+    std::vector<uint8_t> values_8;
+    std::vector<uint16_t> values_16;
+    std::vector<int> values_32;
+
+    template<typename Value>
+    static void fill_columns(
+        const std::vector<TNFState> &samples, int num_variables,
+        std::vector<Value> &values);
+public:
+    SampleMatrix(const std::vector<int> &variable_domains,
+                 const std::vector<TNFState> &samples);
+
+    int get_num_samples() const {
+        return num_samples;
+    }
+
+    int get_value(int sample_id, int var_id) const {
+        int pos = var_id * num_samples + sample_id;
+        if (!values_8.empty()) {
+            return values_8[pos];
+        } else if (!values_16.empty()) {
+            return values_16[pos];
+        } else {
+            return values_32[pos];
+        }
+    }
+
+    SampleView operator[](int sample_id) const {
+        return SampleView(*this, sample_id);
+    }
+
+    /*
+      For all samples i in [begin, end), add multiplier times the value of
+      var_id in sample i to indices[i - begin]. This streams through the
+      column of var_id.
+    */
+    void add_to_indices(int var_id, int multiplier, int begin, int end,
+                        int *indices) const;
+};
+
+inline int SampleView::operator[](int var_id) const {
+    return matrix->get_value(sample_id, var_id);
+}
+}
+
+#endif
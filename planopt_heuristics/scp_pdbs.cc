@@ -0,0 +1,100 @@
+#include "scp_pdbs.h"
+
+#include "../globals.h"
+
+#include "../utils/logging.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <numeric>
+
+using namespace std;
+
+namespace planopt_heuristics {
+static vector<int> get_operator_costs(const TNFTask &task) {
+    vector<int> costs;
+    costs.reserve(task.operators.size());
+    for (const TNFOperator &op : task.operators) {
+        costs.push_back(op.cost);
+    }
+    return costs;
+}
+
+static vector<Pattern> compute_greedy_order(
+    const TNFTask &task, const vector<Pattern> &patterns) {
+    /*
+      Score each pattern by the heuristic value of the initial state under the
+      full costs divided by the costs it needs to keep for this value. Patterns
+      with high scores yield a lot of heuristic value for few costs and should
+      come first.
+    */
+    vector<int> costs = get_operator_costs(task);
+    int num_operators = costs.size();
+    vector<double> scores;
+    scores.reserve(patterns.size());
+    for (const Pattern &pattern : patterns) {
+        PatternDatabase pdb(task, pattern);
+        int init_h = pdb.lookup_distance(task.initial_state);
+        if (init_h == numeric_limits<int>::max()) {
+            scores.push_back(numeric_limits<double>::infinity());
+            continue;
+        }
+        vector<int> saturated_costs = pdb.compute_saturated_costs(num_operators);
+        double used_costs = accumulate(saturated_costs.begin(), saturated_costs.end(), 0.0);
+        scores.push_back(init_h / (used_costs + 1));
+    }
+
+    vector<int> order(patterns.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](int i, int j) {
+            return scores[i] > scores[j];
+        });
+    vector<Pattern> ordered_patterns;
+    ordered_patterns.reserve(patterns.size());
+    for (int i : order) {
+        ordered_patterns.push_back(patterns[i]);
+    }
+    return ordered_patterns;
+}
+
+SaturatedCostPartitioningPDBs::SaturatedCostPartitioningPDBs(
+    const TNFTask &task, const vector<Pattern> &patterns, PatternOrder order) {
+    vector<Pattern> ordered_patterns;
+    if (order == PatternOrder::GREEDY) {
+        ordered_patterns = compute_greedy_order(task, patterns);
+    } else {
+        ordered_patterns = patterns;
+    }
+
+    vector<int> remaining_costs = get_operator_costs(task);
+    int num_operators = remaining_costs.size();
+    pdbs.reserve(ordered_patterns.size());
+    for (const Pattern &pattern : ordered_patterns) {
+        pdbs.emplace_back(task, pattern, remaining_costs);
+        vector<int> saturated_costs = pdbs.back().compute_saturated_costs(num_operators);
+        for (int op_id = 0; op_id < num_operators; ++op_id) {
+            /*
+              Saturated costs never exceed the costs the PDB was computed
+              with, so the remaining costs stay non-negative.
+            */
+            assert(saturated_costs[op_id] <= remaining_costs[op_id]);
+            remaining_costs[op_id] -= saturated_costs[op_id];
+        }
+    }
+    g_log << "Initial heuristic value under saturated cost partitioning: "
+          << compute_heuristic(task.initial_state) << endl;
+}
+
+int SaturatedCostPartitioningPDBs::compute_heuristic(const TNFState &original_state) const {
+    int h = 0;
+    for (const PatternDatabase &pdb : pdbs) {
+        int value = pdb.lookup_distance(original_state);
+        if (value == numeric_limits<int>::max()) {
+            return numeric_limits<int>::max();
+        }
+        h += value;
+    }
+    return h;
+}
+}
@@ -0,0 +1,33 @@
+#ifndef PLANOPT_HEURISTICS_SCP_PDBS_H
+#define PLANOPT_HEURISTICS_SCP_PDBS_H
+
+#include "pdb.h"
+
+#include <vector>
+
+namespace planopt_heuristics {
+
+enum class PatternOrder {
+    // Use the patterns in the given order.
+    GIVEN,
+    // Prefer patterns with a high initial heuristic value per saturated cost.
+    GREEDY
+};
+
+/*
+  Sum of PDBs under saturated cost partitioning: each PDB is computed with the
+  costs left over by the PDBs before it in the order and only keeps the
+  operator costs it needs to preserve its goal distances.
+*/
+class SaturatedCostPartitioningPDBs {
+    std::vector<PatternDatabase> pdbs;
+public:
+    SaturatedCostPartitioningPDBs(
+        const TNFTask &task, const std::vector<Pattern> &patterns,
+        PatternOrder order);
+
+    int compute_heuristic(const TNFState &original_state) const;
+};
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include "swappable_cpdbs.h"
+
+#include "thread_log.h"
+
+using namespace std;
+
+namespace planopt_heuristics {
+SwappableCanonicalPDBs::SwappableCanonicalPDBs()
+    : version(0),
+      interrupted(false),
+      running(false),
+      has_pending_log(false) {
+}
+
+SwappableCanonicalPDBs::~SwappableCanonicalPDBs() {
+    interrupted = true;
+    if (worker.joinable()) {
+        worker.join();
+    }
+    flush_log();
+}
+
+void SwappableCanonicalPDBs::swap(unique_ptr<CanonicalPatternDatabases> new_cpdbs) {
+    /*
+      Publish the collection before increasing the version. A reader that
+      sees the new version thus also sees the new collection.
+    */
+    shared_ptr<const CanonicalPatternDatabases> shared_cpdbs(move(new_cpdbs));
+    atomic_store(&cpdbs, shared_cpdbs);
+    ++version;
+}
+
+void SwappableCanonicalPDBs::start_background_construction(const CPDBsBuilder &build) {
+    if (worker.joinable()) {
+        worker.join();
+    }
+    running = true;
+    worker = thread([this, build]() {
+            unique_ptr<CanonicalPatternDatabases> new_cpdbs;
+            string log;
+            {
+                ThreadLogBuffer log_buffer;
+                new_cpdbs = build(interrupted);
+                if (new_cpdbs && !interrupted) {
+                    thread_log << "Swapped in PDB collection built in the background" << endl;
+                }
+                log = log_buffer.get_text();
+            }
+            {
+                lock_guard<mutex> lock(log_mutex);
+                pending_log += log;
+                has_pending_log = true;
+            }
+            // The log is complete when a reader sees the new version.
+            if (new_cpdbs && !interrupted) {
+                swap(move(new_cpdbs));
+            }
+            running = false;
+        });
+}
+
+void SwappableCanonicalPDBs::flush_log() {
+    if (!has_pending_log) {
+        return;
+    }
+    string log;
+    {
+        lock_guard<mutex> lock(log_mutex);
+        log.swap(pending_log);
+        has_pending_log = false;
+    }
+    write_lines_to_log(log);
+}
+}
@@ -0,0 +1,72 @@
+#ifndef PLANOPT_HEURISTICS_SWAPPABLE_CPDBS_H
+#define PLANOPT_HEURISTICS_SWAPPABLE_CPDBS_H
+
+#include "canonical_pdbs.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace planopt_heuristics {
+using CPDBsBuilder = std::function<std::unique_ptr<CanonicalPatternDatabases>(
+                                       const std::atomic<bool> &interrupted)>;
+
+/*
+  Holds the collection of PDBs a heuristic currently uses. The collection can
+  be replaced by another thread at any time: readers get a shared pointer to
+  the collection, so a collection stays alive as long as someone still uses
+  it. Every swap increases the version, which lets readers cheaply check if
+  they still use the latest collection.
+*/
+class SwappableCanonicalPDBs {
+    std::shared_ptr<const CanonicalPatternDatabases> cpdbs;
+    std::atomic<int> version;
+    std::atomic<bool> interrupted;
+    std::atomic<bool> running;
+    std::thread worker;
+    // Log output of background constructions not yet written to g_log.
+    std::mutex log_mutex;
+    std::string pending_log;
+    std::atomic<bool> has_pending_log;
+public:
+    SwappableCanonicalPDBs();
+    // Interrupts a running background construction and waits for it.
+    ~SwappableCanonicalPDBs();
+
+    SwappableCanonicalPDBs(const SwappableCanonicalPDBs &) = delete;
+    SwappableCanonicalPDBs &operator=(const SwappableCanonicalPDBs &) = delete;
+
+    void swap(std::unique_ptr<CanonicalPatternDatabases> new_cpdbs);
+
+    /*
+      Run build on a background thread and swap in its result unless it is
+      nullptr. build should regularly check its argument and give up when it
+      becomes true. Only one background construction can run at a time, so
+      this waits for the previous one to finish. The log output of build is
+      collected (see thread_log.h) and written by flush_log().
+    */
+    void start_background_construction(const CPDBsBuilder &build);
+    bool is_background_construction_running() const {
+        return running.load();
+    }
+
+    /*
+      Write the log output of finished background constructions to g_log.
+      Must only be called by the thread that owns g_log.
+    */
+    void flush_log();
+
+    int get_version() const {
+        return version.load();
+    }
+
+    std::shared_ptr<const CanonicalPatternDatabases> get() const {
+        return std::atomic_load(&cpdbs);
+    }
+};
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include "systematic_patterns.h"
+
+#include "pattern_hillclimbing.h"
+
+#include "../globals.h"
+
+#include "../utils/logging.h"
+
+#include <algorithm>
+#include <set>
+#include <unordered_set>
+
+using namespace std;
+
+namespace planopt_heuristics {
+static double compute_num_abstract_states(const TNFTask &task, const Pattern &pattern) {
+    double num_states = 1;
+    for (int var_id : pattern) {
+        num_states *= task.variable_domains[var_id];
+    }
+    return num_states;
+}
+
+vector<Pattern> generate_systematic_patterns(
+    const TNFTask &task, int max_pattern_size, int size_bound) {
+    vector<set<int>> causally_relevant_variables = compute_causally_relevant_variables(task);
+
+    /*
+      Every connected pattern that contains a goal variable can be built by
+      starting from that goal variable and adding neighbors in the causal
+      graph one at a time. We grow the patterns layer by layer and only
+      extend patterns that fit the size bound on their own, since adding
+      variables only increases the size.
+    */
+    vector<Pattern> layer;
+    for (size_t var_id = 0; var_id < task.variable_domains.size(); ++var_id) {
+        if (!task.is_unknown_value(var_id, task.goal_state[var_id]) &&
+            task.variable_domains[var_id] <= size_bound) {
+            layer.push_back({static_cast<int>(var_id)});
+        }
+    }
+
+    vector<Pattern> patterns;
+    double collection_size = 0;
+    for (int pattern_size = 1; pattern_size <= max_pattern_size && !layer.empty();
+         ++pattern_size) {
+        for (const Pattern &pattern : layer) {
+            double num_states = compute_num_abstract_states(task, pattern);
+            if (collection_size + num_states <= size_bound) {
+                patterns.push_back(pattern);
+                collection_size += num_states;
+            }
+        }
+        if (pattern_size == max_pattern_size) {
+            break;
+        }
+
+        unordered_set<Pattern, PatternHash> next_layer_patterns;
+        vector<Pattern> next_layer;
+        for (const Pattern &pattern : layer) {
+            double num_states = compute_num_abstract_states(task, pattern);
+            for (int var_id : pattern) {
+                for (int relevant_var_id : causally_relevant_variables[var_id]) {
+                    if (find(pattern.begin(), pattern.end(), relevant_var_id) != pattern.end() ||
+                        num_states * task.variable_domains[relevant_var_id] > size_bound) {
+                        continue;
+                    }
+                    Pattern new_pattern = pattern;
+                    new_pattern.push_back(relevant_var_id);
+                    sort(new_pattern.begin(), new_pattern.end());
+                    if (next_layer_patterns.insert(new_pattern).second) {
+                        next_layer.push_back(move(new_pattern));
+                    }
+                }
+            }
+        }
+        layer = move(next_layer);
+    }
+
+    g_log << "Generated " << patterns.size() << " systematic patterns with "
+          << collection_size << " abstract states" << endl;
+    return patterns;
+}
+}
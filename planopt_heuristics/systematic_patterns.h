@@ -0,0 +1,20 @@
+#ifndef PLANOPT_HEURISTICS_SYSTEMATIC_PATTERNS_H
+#define PLANOPT_HEURISTICS_SYSTEMATIC_PATTERNS_H
+
+#include "projection.h"
+
+#include <vector>
+
+namespace planopt_heuristics {
+/*
+  Enumerate all interesting patterns with at most max_pattern_size variables:
+  patterns that are connected in the causal graph and contain a variable
+  mentioned in the goal of the original task. Smaller patterns are preferred
+  and patterns are only added while the total number of abstract states stays
+  within size_bound.
+*/
+extern std::vector<Pattern> generate_systematic_patterns(
+    const TNFTask &task, int max_pattern_size, int size_bound);
+}
+
+#endif
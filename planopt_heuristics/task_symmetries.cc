@@ -0,0 +1,471 @@
+#include "task_symmetries.h"
+
+#include "../utils/countdown_timer.h"
+#include "../utils/logging.h"
+#include "../utils/timer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <utility>
+
+using namespace std;
+
+namespace planopt_heuristics {
+TaskSymmetry TaskSymmetry::compose(const TaskSymmetry &other) const {
+    TaskSymmetry result;
+    int num_variables = variable_permutation.size();
+    result.variable_permutation.resize(num_variables);
+    result.value_permutations.resize(num_variables);
+    for (int var = 0; var < num_variables; ++var) {
+        int image_var = other.variable_permutation[var];
+        result.variable_permutation[var] = variable_permutation[image_var];
+        for (int image_value : other.value_permutations[var]) {
+            result.value_permutations[var].push_back(
+                value_permutations[image_var][image_value]);
+        }
+    }
+    return result;
+}
+
+TaskSymmetry TaskSymmetry::inverse() const {
+    TaskSymmetry result;
+    int num_variables = variable_permutation.size();
+    result.variable_permutation.resize(num_variables);
+    result.value_permutations.resize(num_variables);
+    for (int var = 0; var < num_variables; ++var) {
+        int image_var = variable_permutation[var];
+        result.variable_permutation[image_var] = var;
+        const vector<int> &values = value_permutations[var];
+        result.value_permutations[image_var].resize(values.size());
+        for (size_t value = 0; value < values.size(); ++value) {
+            result.value_permutations[image_var][values[value]] = value;
+        }
+    }
+    return result;
+}
+
+bool TaskSymmetry::is_identity() const {
+    for (size_t var = 0; var < variable_permutation.size(); ++var) {
+        if (variable_permutation[var] != static_cast<int>(var)) {
+            return false;
+        }
+        const vector<int> &values = value_permutations[var];
+        for (size_t value = 0; value < values.size(); ++value) {
+            if (values[value] != static_cast<int>(value)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+Pattern TaskSymmetry::apply(const Pattern &pattern) const {
+    Pattern image;
+    image.reserve(pattern.size());
+    for (int var : pattern) {
+        image.push_back(variable_permutation[var]);
+    }
+    sort(image.begin(), image.end());
+    return image;
+}
+
+TaskSymmetry create_identity_symmetry(const TNFTask &task) {
+    TaskSymmetry identity;
+    for (size_t var = 0; var < task.variable_domains.size(); ++var) {
+        identity.variable_permutation.push_back(var);
+        vector<int> values(task.variable_domains[var]);
+        for (size_t value = 0; value < values.size(); ++value) {
+            values[value] = value;
+        }
+        identity.value_permutations.push_back(move(values));
+    }
+    return identity;
+}
+
+namespace {
+enum VertexType {
+    VARIABLE,
+    FACT,
+    OPERATOR,
+    ENTRY,
+    MUTEX_GROUP
+};
+
+enum EdgeLabel {
+    VARIABLE_FACT,
+    OPERATOR_ENTRY,
+    ENTRY_PRECONDITION,
+    ENTRY_EFFECT,
+    MUTEX_GROUP_FACT
+};
+
+/*
+  Vertices 0, ..., n-1 are the variables and vertices
+  fact_offsets[v], ..., fact_offsets[v] + k_v - 1 are the facts of variable
+  v. Operators, their entries and mutex groups follow.
+*/
+struct SymmetryGraph {
+    vector<int> fact_offsets;
+    vector<int> initial_colors;
+    /*
+      Sorted pairs (label, neighbor) for each vertex. Outgoing edges have
+      label 2 * l and incoming edges label 2 * l + 1 for an EdgeLabel l.
+    */
+    vector<vector<pair<int, int>>> adjacency;
+
+    explicit SymmetryGraph(const TNFTask &task);
+
+    int get_num_vertices() const {
+        return initial_colors.size();
+    }
+};
+}
+
+SymmetryGraph::SymmetryGraph(const TNFTask &task) {
+    vector<vector<int>> vertex_keys;
+    auto add_vertex = [&](vector<int> key) {
+            vertex_keys.push_back(move(key));
+            adjacency.emplace_back();
+            return static_cast<int>(vertex_keys.size()) - 1;
+        };
+    auto add_edge = [&](int from, int to, EdgeLabel label) {
+            adjacency[from].emplace_back(2 * label, to);
+            adjacency[to].emplace_back(2 * label + 1, from);
+        };
+
+    int num_variables = task.variable_domains.size();
+    for (int var = 0; var < num_variables; ++var) {
+        add_vertex({VARIABLE});
+    }
+    for (int var = 0; var < num_variables; ++var) {
+        fact_offsets.push_back(vertex_keys.size());
+        for (int value = 0; value < task.variable_domains[var]; ++value) {
+            int fact = add_vertex(
+                {FACT, task.goal_state[var] == value, task.is_unknown_value(var, value)});
+            add_edge(var, fact, VARIABLE_FACT);
+        }
+    }
+    for (const TNFOperator &op : task.operators) {
+        int op_vertex = add_vertex({OPERATOR, op.cost});
+        for (const TNFOperatorEntry &entry : op.entries) {
+            int entry_vertex = add_vertex({ENTRY});
+            int offset = fact_offsets[entry.variable_id];
+            add_edge(op_vertex, entry_vertex, OPERATOR_ENTRY);
+            add_edge(entry_vertex, offset + entry.precondition_value, ENTRY_PRECONDITION);
+            add_edge(entry_vertex, offset + entry.effect_value, ENTRY_EFFECT);
+        }
+    }
+    for (const vector<FactPair> &group : task.mutex_groups) {
+        int group_vertex = add_vertex({MUTEX_GROUP});
+        for (const FactPair &fact : group) {
+            add_edge(group_vertex, fact_offsets[fact.var] + fact.value, MUTEX_GROUP_FACT);
+        }
+    }
+
+    for (vector<pair<int, int>> &neighbors : adjacency) {
+        sort(neighbors.begin(), neighbors.end());
+    }
+    map<vector<int>, int> key_colors;
+    for (const vector<int> &key : vertex_keys) {
+        key_colors[key] = 0;
+    }
+    int num_colors = 0;
+    for (auto &key_and_color : key_colors) {
+        key_and_color.second = num_colors++;
+    }
+    for (const vector<int> &key : vertex_keys) {
+        initial_colors.push_back(key_colors[key]);
+    }
+}
+
+static int get_num_colors(const vector<int> &colors) {
+    return colors.empty() ? 0 : *max_element(colors.begin(), colors.end()) + 1;
+}
+
+/*
+  Refine the colorings of two copies of the graph until they are equitable.
+  Colors are numbered 0, ..., k-1 and new colors are assigned in the order of
+  the vertex signatures, so corresponding vertices of the copies keep equal
+  colors. Returns false if the color classes of the copies get different
+  sizes, i.e., no automorphism maps the first coloring to the second.
+*/
+static bool refine(const SymmetryGraph &graph, vector<int> &colors1, vector<int> &colors2) {
+    int num_vertices = graph.get_num_vertices();
+    int num_colors = get_num_colors(colors1);
+    vector<vector<int>> signatures1(num_vertices);
+    vector<vector<int>> signatures2(num_vertices);
+    vector<pair<int, int>> neighbor_colors;
+    while (true) {
+        map<vector<int>, int> signature_colors;
+        for (int copy = 0; copy < 2; ++copy) {
+            const vector<int> &colors = copy ? colors2 : colors1;
+            vector<vector<int>> &signatures = copy ? signatures2 : signatures1;
+            for (int vertex = 0; vertex < num_vertices; ++vertex) {
+                neighbor_colors.clear();
+                for (const pair<int, int> &edge : graph.adjacency[vertex]) {
+                    neighbor_colors.emplace_back(edge.first, colors[edge.second]);
+                }
+                sort(neighbor_colors.begin(), neighbor_colors.end());
+                vector<int> &signature = signatures[vertex];
+                signature.assign(1, colors[vertex]);
+                for (const pair<int, int> &neighbor : neighbor_colors) {
+                    signature.push_back(neighbor.first);
+                    signature.push_back(neighbor.second);
+                }
+                signature_colors[signature] = 0;
+            }
+        }
+        int num_new_colors = 0;
+        for (auto &signature_and_color : signature_colors) {
+            signature_and_color.second = num_new_colors++;
+        }
+
+        vector<int> class_sizes(num_new_colors, 0);
+        for (int vertex = 0; vertex < num_vertices; ++vertex) {
+            colors1[vertex] = signature_colors[signatures1[vertex]];
+            colors2[vertex] = signature_colors[signatures2[vertex]];
+            ++class_sizes[colors1[vertex]];
+            --class_sizes[colors2[vertex]];
+        }
+        if (any_of(class_sizes.begin(), class_sizes.end(),
+                   [](int difference) {return difference != 0; })) {
+            return false;
+        }
+        if (num_new_colors == num_colors) {
+            return true;
+        }
+        num_colors = num_new_colors;
+    }
+}
+
+// Smallest color with more than one vertex or -1 if the coloring is discrete.
+static int find_nonsingleton_color(const vector<int> &colors) {
+    vector<int> class_sizes(get_num_colors(colors), 0);
+    for (int color : colors) {
+        ++class_sizes[color];
+    }
+    for (size_t color = 0; color < class_sizes.size(); ++color) {
+        if (class_sizes[color] > 1) {
+            return color;
+        }
+    }
+    return -1;
+}
+
+static vector<int> get_vertices_with_color(const vector<int> &colors, int color) {
+    vector<int> vertices;
+    for (size_t vertex = 0; vertex < colors.size(); ++vertex) {
+        if (colors[vertex] == color) {
+            vertices.push_back(vertex);
+        }
+    }
+    return vertices;
+}
+
+static bool is_automorphism(const SymmetryGraph &graph, const vector<int> &mapping) {
+    for (int vertex = 0; vertex < graph.get_num_vertices(); ++vertex) {
+        int image = mapping[vertex];
+        if (graph.initial_colors[vertex] != graph.initial_colors[image]) {
+            return false;
+        }
+        const vector<pair<int, int>> &image_neighbors = graph.adjacency[image];
+        for (const pair<int, int> &edge : graph.adjacency[vertex]) {
+            if (!binary_search(image_neighbors.begin(), image_neighbors.end(),
+                               make_pair(edge.first, mapping[edge.second]))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+  Search for an automorphism that maps each vertex with color c in colors1 to
+  a vertex with color c in colors2 by individualizing corresponding vertices
+  until the colorings are discrete.
+*/
+static bool find_automorphism(
+    const SymmetryGraph &graph, vector<int> colors1, vector<int> colors2,
+    const utils::CountdownTimer &timer, vector<int> &mapping) {
+    if (timer.is_expired() || !refine(graph, colors1, colors2)) {
+        return false;
+    }
+    int color = find_nonsingleton_color(colors1);
+    if (color == -1) {
+        vector<int> vertex_with_color(colors2.size());
+        for (size_t vertex = 0; vertex < colors2.size(); ++vertex) {
+            vertex_with_color[colors2[vertex]] = vertex;
+        }
+        mapping.resize(colors1.size());
+        for (size_t vertex = 0; vertex < colors1.size(); ++vertex) {
+            mapping[vertex] = vertex_with_color[colors1[vertex]];
+        }
+        return is_automorphism(graph, mapping);
+    }
+
+    int new_color = get_num_colors(colors1);
+    int vertex = get_vertices_with_color(colors1, color).front();
+    for (int image : get_vertices_with_color(colors2, color)) {
+        vector<int> individualized1(colors1);
+        vector<int> individualized2(colors2);
+        individualized1[vertex] = new_color;
+        individualized2[image] = new_color;
+        if (find_automorphism(graph, move(individualized1), move(individualized2),
+                              timer, mapping)) {
+            return true;
+        }
+        if (timer.is_expired()) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static TaskSymmetry create_symmetry(
+    const TNFTask &task, const SymmetryGraph &graph, const vector<int> &mapping) {
+    TaskSymmetry symmetry;
+    int num_variables = task.variable_domains.size();
+    for (int var = 0; var < num_variables; ++var) {
+        int image_var = mapping[var];
+        symmetry.variable_permutation.push_back(image_var);
+        vector<int> values;
+        for (int value = 0; value < task.variable_domains[var]; ++value) {
+            values.push_back(
+                mapping[graph.fact_offsets[var] + value] - graph.fact_offsets[image_var]);
+        }
+        symmetry.value_permutations.push_back(move(values));
+    }
+    return symmetry;
+}
+
+TaskSymmetries::TaskSymmetries(const TNFTask &task, double max_time)
+    : identity(create_identity_symmetry(task)) {
+    /*
+      We compute a generating set along a stabilizer chain: on each level, we
+      individualize the first vertex x of the first non-singleton color class
+      and search for automorphisms mapping x to each other vertex y of the
+      class that is not yet in the orbit of x under the automorphisms found
+      on this level. All of them fix the vertices individualized before.
+    */
+    utils::Timer timer;
+    utils::CountdownTimer countdown(max_time);
+    SymmetryGraph graph(task);
+    int num_vertices = graph.get_num_vertices();
+    vector<int> colors = graph.initial_colors;
+    vector<int> copy = colors;
+    refine(graph, colors, copy);
+    bool complete = true;
+    while (true) {
+        int color = find_nonsingleton_color(colors);
+        if (color == -1) {
+            break;
+        }
+        vector<int> cell = get_vertices_with_color(colors, color);
+        int vertex = cell.front();
+        int new_color = get_num_colors(colors);
+        vector<vector<int>> level_automorphisms;
+        vector<bool> in_orbit(num_vertices, false);
+        in_orbit[vertex] = true;
+        for (int image : cell) {
+            if (in_orbit[image]) {
+                continue;
+            }
+            if (countdown.is_expired()) {
+                break;
+            }
+            vector<int> colors1(colors);
+            vector<int> colors2(colors);
+            colors1[vertex] = new_color;
+            colors2[image] = new_color;
+            vector<int> mapping;
+            if (!find_automorphism(graph, move(colors1), move(colors2), countdown, mapping)) {
+                continue;
+            }
+            TaskSymmetry symmetry = create_symmetry(task, graph, mapping);
+            if (!symmetry.is_identity()) {
+                generators.push_back(symmetry.inverse());
+                generators.push_back(move(symmetry));
+            }
+            level_automorphisms.push_back(move(mapping));
+
+            // Close the orbit of vertex under the automorphisms of this level.
+            vector<int> open;
+            for (int v = 0; v < num_vertices; ++v) {
+                if (in_orbit[v]) {
+                    open.push_back(v);
+                }
+            }
+            while (!open.empty()) {
+                int v = open.back();
+                open.pop_back();
+                for (const vector<int> &automorphism : level_automorphisms) {
+                    if (!in_orbit[automorphism[v]]) {
+                        in_orbit[automorphism[v]] = true;
+                        open.push_back(automorphism[v]);
+                    }
+                }
+            }
+        }
+        if (countdown.is_expired()) {
+            complete = false;
+            break;
+        }
+        colors[vertex] = new_color;
+        copy = colors;
+        refine(graph, colors, copy);
+    }
+    g_log << "Found " << generators.size() / 2 << " symmetry generators in "
+          << timer() << "s" << (complete ? "" : " (time limit reached)") << endl;
+}
+
+Pattern TaskSymmetries::compute_representative(
+    const Pattern &pattern, TaskSymmetry &symmetry) const {
+    symmetry = identity;
+    Pattern representative(pattern);
+    sort(representative.begin(), representative.end());
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const TaskSymmetry &generator : generators) {
+            Pattern image = generator.apply(representative);
+            if (image < representative) {
+                representative = move(image);
+                symmetry = generator.compose(symmetry);
+                changed = true;
+            }
+        }
+    }
+    return representative;
+}
+
+Projection create_symmetric_projection(
+    const TNFTask &task, const Pattern &pattern, const Projection &image_projection,
+    const TaskSymmetry &symmetry) {
+    const Pattern &image_pattern = image_projection.get_pattern();
+    const vector<int> &image_multipliers = image_projection.get_perfect_hash_multipliers();
+    vector<int> multipliers;
+    vector<ValueMapping> value_mappings;
+    bool permutes_values = image_projection.is_domain_abstraction();
+    for (int var : pattern) {
+        auto it = find(image_pattern.begin(), image_pattern.end(),
+                       symmetry.variable_permutation[var]);
+        assert(it != image_pattern.end());
+        int image_index = it - image_pattern.begin();
+        multipliers.push_back(image_multipliers[image_index]);
+        ValueMapping value_mapping(task.variable_domains[var]);
+        for (size_t value = 0; value < value_mapping.size(); ++value) {
+            value_mapping[value] = image_projection.get_abstract_value(
+                image_index, symmetry.value_permutations[var][value]);
+            if (value_mapping[value] != static_cast<int>(value)) {
+                permutes_values = true;
+            }
+        }
+        value_mappings.push_back(move(value_mapping));
+    }
+    if (!permutes_values) {
+        value_mappings.clear();
+    }
+    return Projection(task, pattern, value_mappings, multipliers);
+}
+}
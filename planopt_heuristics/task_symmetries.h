@@ -0,0 +1,69 @@
+#ifndef PLANOPT_HEURISTICS_TASK_SYMMETRIES_H
+#define PLANOPT_HEURISTICS_TASK_SYMMETRIES_H
+
+#include "projection.h"
+
+#include <vector>
+
+namespace planopt_heuristics {
+/*
+  A structural symmetry of a TNF task maps variable v to
+  variable_permutation[v] and value d of v to value_permutations[v][d]. It
+  maps operators to operators with the same cost, the goal state to itself
+  and mutex groups to mutex groups. The initial state does not have to be
+  preserved, so the projection of a state to a pattern P has the same goal
+  distance as the projection of its image to the image of P.
+*/
+struct TaskSymmetry {
+    std::vector<int> variable_permutation;
+    std::vector<std::vector<int>> value_permutations;
+
+    // Apply other first and then this symmetry.
+    TaskSymmetry compose(const TaskSymmetry &other) const;
+    TaskSymmetry inverse() const;
+    bool is_identity() const;
+    // Sorted image of a pattern.
+    Pattern apply(const Pattern &pattern) const;
+};
+
+extern TaskSymmetry create_identity_symmetry(const TNFTask &task);
+
+/*
+  Generators of the symmetry group of a task. They are automorphisms of a
+  colored graph with vertices for variables, facts, operators, operator
+  entries and mutex groups, found by color refinement and individualization.
+  Goal facts, unknown values and operator costs are encoded in the colors.
+  If the time limit is reached, only the generators found so far are kept.
+*/
+class TaskSymmetries {
+    TaskSymmetry identity;
+    // Generators and their inverses.
+    std::vector<TaskSymmetry> generators;
+public:
+    TaskSymmetries(const TNFTask &task, double max_time);
+
+    /*
+      Map pattern to a representative of its orbit by applying generators as
+      long as the sorted image gets lexicographically smaller. Patterns of the
+      same orbit usually, but not always, get the same representative. The
+      symmetry mapping pattern to the representative is stored in symmetry.
+    */
+    Pattern compute_representative(const Pattern &pattern, TaskSymmetry &symmetry) const;
+
+    bool empty() const {
+        return generators.empty();
+    }
+};
+
+/*
+  Projection to pattern that ranks the projection of a state like
+  image_projection ranks the projection of the image of the state under
+  symmetry, which must map pattern to the pattern of image_projection. The
+  goal distances of image_projection can then be looked up for pattern.
+*/
+extern Projection create_symmetric_projection(
+    const TNFTask &task, const Pattern &pattern, const Projection &image_projection,
+    const TaskSymmetry &symmetry);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#include "thread_log.h"
+
+using namespace std;
+
+namespace planopt_heuristics {
+static thread_local ostringstream *current_buffer = nullptr;
+
+ThreadLog thread_log;
+
+ThreadLogBuffer::ThreadLogBuffer()
+    : previous_stream(current_buffer) {
+    current_buffer = &stream;
+}
+
+ThreadLogBuffer::~ThreadLogBuffer() {
+    current_buffer = previous_stream;
+}
+
+ostringstream *ThreadLog::get_buffer() {
+    return current_buffer;
+}
+
+void write_lines_to_log(const string &text) {
+    istringstream lines(text);
+    string line;
+    while (getline(lines, line)) {
+        g_log << line << endl;
+    }
+}
+}
@@ -0,0 +1,65 @@
+#ifndef PLANOPT_HEURISTICS_THREAD_LOG_H
+#define PLANOPT_HEURISTICS_THREAD_LOG_H
+
+#include "../utils/logging.h"
+
+#include <ostream>
+#include <sstream>
+#include <string>
+
+namespace planopt_heuristics {
+/*
+  g_log is not thread-safe and the search writes to it while collections are
+  built in the background. Code that can run on a background thread logs to
+  thread_log instead. On a thread with a ThreadLogBuffer, the output is
+  collected in the buffer, so the main thread can write it to g_log later.
+  On all other threads, it goes directly to g_log.
+*/
+class ThreadLogBuffer {
+    std::ostringstream stream;
+    std::ostringstream *previous_stream;
+public:
+    ThreadLogBuffer();
+    ~ThreadLogBuffer();
+
+    ThreadLogBuffer(const ThreadLogBuffer &) = delete;
+    ThreadLogBuffer &operator=(const ThreadLogBuffer &) = delete;
+
+    std::string get_text() const {
+        return stream.str();
+    }
+};
+
+class ThreadLog {
+    // Buffer of the calling thread or nullptr.
+    static std::ostringstream *get_buffer();
+public:
+    template<typename T>
+    ThreadLog &operator<<(const T &value) {
+        std::ostringstream *buffer = get_buffer();
+        if (buffer) {
+            *buffer << value;
+        } else {
+            g_log << value;
+        }
+        return *this;
+    }
+
+    ThreadLog &operator<<(std::ostream &(*manipulator)(std::ostream &)) {
+        std::ostringstream *buffer = get_buffer();
+        if (buffer) {
+            *buffer << manipulator;
+        } else {
+            g_log << manipulator;
+        }
+        return *this;
+    }
+};
+
+extern ThreadLog thread_log;
+
+// Write text collected by a ThreadLogBuffer to g_log line by line.
+extern void write_lines_to_log(const std::string &text);
+}
+
+#endif
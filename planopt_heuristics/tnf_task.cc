@@ -117,6 +117,7 @@ TNFTask create_tnf_task(const TaskProxy &sas_task) {
       Create variables.
     */
     tnf_task.variable_domains.reserve(num_sas_variables);
+    tnf_task.has_unknown_value = unknown_fact_needed;
     for (VariableProxy var : sas_variables) {
         tnf_task.variable_domains.push_back(var.get_domain_size());
         if (unknown_fact_needed[var.get_id()]) {
@@ -124,6 +125,26 @@ TNFTask create_tnf_task(const TaskProxy &sas_task) {
         }
     }
 
+    /*
+      Collect mutexes between facts of different variables as mutex groups of
+      size two.
+    */
+    for (VariableProxy var1 : sas_variables) {
+        for (int var2_id = var1.get_id() + 1; var2_id < num_sas_variables; ++var2_id) {
+            VariableProxy var2 = sas_variables[var2_id];
+            for (int value1 = 0; value1 < var1.get_domain_size(); ++value1) {
+                FactProxy fact1 = var1.get_fact(value1);
+                for (int value2 = 0; value2 < var2.get_domain_size(); ++value2) {
+                    FactProxy fact2 = var2.get_fact(value2);
+                    if (fact1.is_mutex(fact2)) {
+                        tnf_task.mutex_groups.push_back(
+                            {fact1.get_pair(), fact2.get_pair()});
+                    }
+                }
+            }
+        }
+    }
+
     return tnf_task;
 }
 }
@@ -51,6 +51,14 @@ struct TNFTask {
     */
     std::vector<int> variable_domains;
 
+    /*
+      Variables that received an additional "unknown" value use the last value
+      of their domain for it. Operators of the SAS+ task keep their index and
+      use the unknown value as precondition for variables they change without
+      requiring a value.
+    */
+    std::vector<bool> has_unknown_value;
+
     TNFState initial_state;
 
     // In TNF there is only one goal state.
@@ -59,6 +67,17 @@ struct TNFTask {
     // All operators are in TNF (see documentation above).
     std::vector<TNFOperator> operators;
 
+    /*
+      Each mutex group is a set of facts of different variables of which at
+      most one can be true in a reachable state. The "unknown" values never
+      occur in mutex groups.
+    */
+    std::vector<std::vector<FactPair>> mutex_groups;
+
+    bool is_unknown_value(int var_id, int value) const {
+        return has_unknown_value[var_id] && value == variable_domains[var_id] - 1;
+    }
+
     int get_num_states() const {
         int result = 1;
         for (int d : variable_domains) {